@@ -106,8 +106,18 @@ public:
     std::shared_ptr<CType> ty;
     Token tok;
     bool isLValue{false};
-    AstNode(Kind kind): kind(kind) {}
+    AstNode(Kind kind): kind(kind) {
+        if (uint64_t *counts = AllocCounts()) {
+            ++counts[kind];
+        }
+    }
     Kind GetKind() const {return kind;}
+    /// -fmem-report: 当前线程把各类节点的个数累加到这个数组 (由 MemReport 设置)，为空时不计数
+    /// 一个编译单元在同一个线程中完成前端
+    static uint64_t *&AllocCounts() {
+        static thread_local uint64_t *counts = nullptr;
+        return counts;
+    }
     virtual llvm::Value * Accept(Visitor *v) {return nullptr;}
 };
 
@@ -314,6 +324,8 @@ public:
 class FuncDecl : public AstNode {
 public:
     std::shared_ptr<AstNode> blockStmt{nullptr};
+    /// static 函数是 internal 的，不同编译单元中的同名函数互不冲突
+    bool isStatic{false};
     FuncDecl():AstNode(ND_FuncDecl) {}
 
     llvm::Value * Accept(Visitor *v) override {
@@ -0,0 +1,468 @@
+/// subc-bench: 多次编译 demo/ 下的程序和生成的大输入，统计各阶段耗时、峰值内存和 IR 指令数，输出 JSON
+/// 每个输入在 fork 出的子进程中测量: DiagEngine 报错时会直接 exit，峰值内存也能按输入统计
+#include "driver.h"
+#include "mem_usage.h"
+#include "synthetic.h"
+#include "time_report.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/WithColor.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::list<std::string>
+Inputs(cl::Positional, cl::desc("<c files or directories> (default = demo/)"));
+
+static cl::opt<std::string>
+OutputFilename("o", cl::desc("Output JSON filename (default = stdout)"), cl::value_desc("filename"),
+               cl::init("-"));
+
+static cl::opt<unsigned>
+Iterations("n", cl::desc("Number of times each input is compiled (default = 5)"), cl::init(5));
+
+static cl::opt<char>
+OptLevel("O", cl::desc("Optimization level. [-O0, -O1, -O2, -O3, -Os or -Oz] (default = '-O2')"),
+         cl::Prefix, cl::init('2'));
+
+static cl::list<unsigned>
+SyntheticFunctions("synthetic", cl::CommaSeparated,
+                   cl::desc("Also compile generated programs with the given numbers of functions (default = 100,1000)"));
+
+static cl::list<std::string>
+Scale("scale", cl::CommaSeparated,
+      cl::desc("Sweep generated programs along the given dimensions (functions, nesting, global-table, "
+               "expr-chain, structs or all) and report how each phase grows"));
+
+static cl::opt<unsigned>
+ScaleSteps("scale-steps", cl::desc("Number of sizes per dimension, doubling each step (default = 4)"), cl::init(4));
+
+static cl::opt<std::string>
+Baseline("baseline", cl::desc("Compare median total times with a previous subc-bench JSON"),
+         cl::value_desc("filename"));
+
+static cl::opt<double>
+Threshold("threshold", cl::desc("Slowdown in percent reported as a regression (default = 5)"), cl::init(5.0));
+
+namespace {
+struct BenchInput {
+  std::string Name;
+  std::string Source;
+  /// -scale 生成的输入: 所属的维度和大小
+  std::string Dimension;
+  unsigned Size{0};
+};
+
+static const char *const PhaseNames[] = {"lex", "parse", "codegen", "opt", "backend", "total"};
+
+/// 每个阶段在多次迭代中的耗时，单位 ms
+struct PhaseSamples {
+  const char *Name;
+  std::vector<double> Samples;
+};
+} // namespace
+
+/// 目录中的 .c 文件按文件名排序，名字形如 demo/nqueen.c，不依赖机器上的绝对路径
+static bool CollectInputs(StringRef Path, std::vector<BenchInput> &Result) {
+  std::vector<std::string> Files;
+  std::string Prefix;
+  if (sys::fs::is_directory(Path)) {
+    std::error_code EC;
+    for (sys::fs::directory_iterator It(Path, EC), End; It != End && !EC; It.increment(EC))
+      if (sys::path::extension(It->path()) == ".c")
+        Files.push_back(It->path());
+    llvm::sort(Files);
+    Prefix = (sys::path::filename(sys::path::remove_leading_dotslash(Path)) + "/").str();
+  } else {
+    Files.push_back(Path.str());
+  }
+
+  for (const auto &File : Files) {
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buf = MemoryBuffer::getFile(File);
+    if (!Buf) {
+      WithColor::error() << "can't open file '" << File << "'\n";
+      return false;
+    }
+    Result.push_back({Prefix + sys::path::filename(File).str(), (*Buf)->getBuffer().str()});
+  }
+  return true;
+}
+
+static double Median(std::vector<double> Samples) {
+  llvm::sort(Samples);
+  size_t N = Samples.size();
+  return N % 2 ? Samples[N / 2] : (Samples[N / 2 - 1] + Samples[N / 2]) / 2;
+}
+
+/// 在子进程中执行: 把一个输入编译 Iterations 次，结果以 JSON 对象的形式写到 OS
+/// 每次迭代都用新的 Driver 走和 subc 相同的 GenerateModule/OptimizeModule/EmitFile，lex 阶段包含读取和扫描头文件
+static void MeasureInput(const BenchInput &Input, const CompileOptions &Opts, raw_ostream &OS) {
+  using Clock = std::chrono::steady_clock;
+  auto Ms = [](Clock::time_point Start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+  };
+  auto TimerMs = [](const Timer &T) { return T.getTotalTime().getWallTime() * 1000; };
+
+  PhaseSamples Phases[std::size(PhaseNames)];
+  for (size_t I = 0; I < std::size(PhaseNames); ++I)
+    Phases[I].Name = PhaseNames[I];
+  uint64_t Tokens = 0, IRInstructions = 0, IRInstructionsOpt = 0;
+  ResetPeakRSS();
+
+  for (unsigned I = 0; I < Iterations; ++I) {
+    Driver D(Opts);
+    if (!D.InitTarget())
+      _exit(1);
+    TimeReport Report(Input.Name);
+
+    // Lex, parse and codegen are split by the same timers as -ftime-report.
+    auto Start = Clock::now();
+    ModuleUnit Unit;
+    if (!D.GenerateModule(MemoryBuffer::getMemBufferCopy(Input.Source, Input.Name), Unit, &Report))
+      _exit(1);
+    Phases[0].Samples.push_back(TimerMs(Report.lexTimer));
+    Phases[1].Samples.push_back(TimerMs(Report.parseTimer));
+    Phases[2].Samples.push_back(TimerMs(Report.codegenTimer));
+    Report.Clear();
+    Tokens = Unit.numTokens;
+
+    Module &M = *Unit.module;
+    std::unique_ptr<TargetMachine> TM = D.CreateTargetMachine(M);
+    IRInstructions = M.getInstructionCount();
+
+    auto PhaseStart = Clock::now();
+    if (Opts.optLevel != OptimizationLevel::O0)
+      D.OptimizeModule(M, TM.get());
+    Phases[3].Samples.push_back(Ms(PhaseStart));
+    IRInstructionsOpt = M.getInstructionCount();
+
+    PhaseStart = Clock::now();
+    D.EmitFile(M, TM.get(), "/dev/null");
+    Phases[4].Samples.push_back(Ms(PhaseStart));
+    Phases[5].Samples.push_back(Ms(Start));
+  }
+
+  json::OStream J(OS);
+  J.object([&] {
+    J.attribute("name", Input.Name);
+    J.attribute("bytes", (int64_t)Input.Source.size());
+    J.attribute("lines", (int64_t)StringRef(Input.Source).count('\n'));
+    J.attribute("tokens", (int64_t)Tokens);
+    J.attribute("ir_instructions", (int64_t)IRInstructions);
+    J.attribute("ir_instructions_optimized", (int64_t)IRInstructionsOpt);
+    J.attribute("peak_rss_bytes", (int64_t)GetPeakRSS());
+    J.attributeObject("phases_ms", [&] {
+      for (const auto &Phase : Phases) {
+        J.attributeObject(Phase.Name, [&] {
+          J.attribute("min", *std::min_element(Phase.Samples.begin(), Phase.Samples.end()));
+          J.attribute("median", Median(Phase.Samples));
+        });
+      }
+    });
+  });
+}
+
+/// fork 一个子进程测量，子进程因为编译错误或者崩溃退出时返回 None
+static std::optional<json::Value> RunInChild(const BenchInput &Input, const CompileOptions &Opts) {
+  int Fds[2];
+  if (pipe(Fds) != 0)
+    return std::nullopt;
+  outs().flush();
+  errs().flush();
+
+  pid_t Pid = fork();
+  if (Pid == 0) {
+    close(Fds[0]);
+    std::string Result;
+    raw_string_ostream OS(Result);
+    MeasureInput(Input, Opts, OS);
+    OS.flush();
+    (void)!write(Fds[1], Result.data(), Result.size());
+    close(Fds[1]);
+    _exit(0);
+  }
+  close(Fds[1]);
+  if (Pid < 0) {
+    close(Fds[0]);
+    return std::nullopt;
+  }
+
+  std::string Result;
+  char Buf[4096];
+  ssize_t N;
+  while ((N = read(Fds[0], Buf, sizeof(Buf))) > 0)
+    Result.append(Buf, N);
+  close(Fds[0]);
+
+  int Status;
+  waitpid(Pid, &Status, 0);
+  if (!WIFEXITED(Status) || WEXITSTATUS(Status) != 0 || Result.empty())
+    return std::nullopt;
+  Expected<json::Value> V = json::parse(Result);
+  if (!V) {
+    consumeError(V.takeError());
+    return std::nullopt;
+  }
+  return std::move(*V);
+}
+
+static std::optional<double> GetPhaseMedian(const json::Value &Input, StringRef Phase) {
+  const json::Object *Obj = Input.getAsObject();
+  if (!Obj)
+    return std::nullopt;
+  const json::Object *Phases = Obj->getObject("phases_ms");
+  const json::Object *Times = Phases ? Phases->getObject(Phase) : nullptr;
+  return Times ? Times->getNumber("median") : std::nullopt;
+}
+
+/// 每个维度从 Start 开始，每一步翻倍；其它维度(包括 functions)为 0，只测量这一个维度
+static const struct {
+  const char *Dimension;
+  unsigned Start;
+} ScaleStarts[] = {{"functions", 250}, {"nesting", 64}, {"global-table", 16384}, {"expr-chain", 512}, {"structs", 256}};
+
+static bool AddScaleInputs(std::vector<BenchInput> &Result) {
+  std::vector<std::string> Dimensions;
+  for (const auto &Dimension : Scale) {
+    if (Dimension == "all") {
+      for (StringRef D : GetSyntheticDimensions())
+        Dimensions.push_back(D.str());
+    } else if (llvm::is_contained(GetSyntheticDimensions(), Dimension)) {
+      Dimensions.push_back(Dimension);
+    } else {
+      WithColor::error() << "unknown dimension '" << Dimension << "' for -scale\n";
+      return false;
+    }
+  }
+
+  for (const auto &Dimension : Dimensions) {
+    unsigned Size = 0;
+    for (const auto &Start : ScaleStarts)
+      if (Dimension == Start.Dimension)
+        Size = Start.Start;
+    for (unsigned Step = 0; Step < ScaleSteps; ++Step, Size *= 2) {
+      SyntheticOptions SynOpts;
+      SynOpts.functions = 0;
+      SetSyntheticDimension(SynOpts, Dimension, Size);
+      Result.push_back({"synthetic/" + Dimension + "=" + std::to_string(Size), GenerateSyntheticProgram(SynOpts),
+                        Dimension, Size});
+    }
+  }
+  return true;
+}
+
+/// 在 log-log 坐标下对 (size, time) 做最小二乘拟合，斜率就是增长的阶数: 1 是线性，2 是平方
+static std::optional<double> GetGrowthExponent(ArrayRef<std::pair<double, double>> Points) {
+  if (Points.size() < 2)
+    return std::nullopt;
+  double SumX = 0, SumY = 0, SumXX = 0, SumXY = 0;
+  for (const auto &[Size, Time] : Points) {
+    double X = std::log(Size), Y = std::log(std::max(Time, 1e-6));
+    SumX += X;
+    SumY += Y;
+    SumXX += X * X;
+    SumXY += X * Y;
+  }
+  double N = Points.size();
+  double Denominator = N * SumXX - SumX * SumX;
+  if (Denominator == 0)
+    return std::nullopt;
+  return (N * SumXY - SumX * SumY) / Denominator;
+}
+
+/// 按维度汇总 -scale 的结果: 每个大小的各阶段 median，以及拟合出的增长阶数；同时把表格打印到 OS
+static json::Array GetScaling(ArrayRef<const BenchInput *> Measured, const json::Array &Results, raw_ostream &OS) {
+  json::Array Scaling;
+  std::vector<std::string> Dimensions;
+  for (const BenchInput *Input : Measured)
+    if (!Input->Dimension.empty() && !llvm::is_contained(Dimensions, Input->Dimension))
+      Dimensions.push_back(Input->Dimension);
+
+  for (const auto &Dimension : Dimensions) {
+    OS << "\n" << left_justify(Dimension, 14);
+    for (const char *Phase : PhaseNames)
+      OS << right_justify(Phase, 11);
+    OS << "\n";
+
+    json::Array Sizes;
+    std::vector<std::pair<double, double>> Points[std::size(PhaseNames)];
+    for (size_t I = 0; I < Measured.size(); ++I) {
+      if (Measured[I]->Dimension != Dimension)
+        continue;
+      Sizes.push_back((int64_t)Measured[I]->Size);
+      OS << left_justify(std::to_string(Measured[I]->Size), 14);
+      for (size_t P = 0; P < std::size(PhaseNames); ++P) {
+        double Time = GetPhaseMedian(Results[I], PhaseNames[P]).value_or(0);
+        Points[P].push_back({(double)Measured[I]->Size, Time});
+        OS << format("%11.2f", Time);
+      }
+      OS << "\n";
+    }
+
+    json::Object Exponents;
+    OS << left_justify("exponent", 14);
+    for (size_t P = 0; P < std::size(PhaseNames); ++P) {
+      if (std::optional<double> Exponent = GetGrowthExponent(Points[P])) {
+        Exponents[PhaseNames[P]] = std::round(*Exponent * 100) / 100;
+        OS << format("%11.2f", *Exponent);
+      } else {
+        OS << right_justify("-", 11);
+      }
+    }
+    OS << "\n";
+
+    Scaling.push_back(json::Object{
+        {"dimension", Dimension}, {"sizes", std::move(Sizes)}, {"exponents", std::move(Exponents)}});
+  }
+  return Scaling;
+}
+
+/// 与 baseline 比较每个输入的 median total，返回是否有超过阈值的退化
+static bool CompareWithBaseline(const json::Array &Results, raw_ostream &OS) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buf = MemoryBuffer::getFile(Baseline);
+  if (!Buf) {
+    WithColor::error() << "can't open baseline '" << Baseline << "'\n";
+    return true;
+  }
+  Expected<json::Value> Base = json::parse((*Buf)->getBuffer());
+  if (!Base) {
+    WithColor::error() << "invalid baseline '" << Baseline << "': " << toString(Base.takeError()) << "\n";
+    return true;
+  }
+  const json::Object *BaseObj = Base->getAsObject();
+  const json::Array *BaseInputs = BaseObj ? BaseObj->getArray("inputs") : nullptr;
+  if (!BaseInputs) {
+    WithColor::error() << "baseline '" << Baseline << "' has no inputs\n";
+    return true;
+  }
+
+  StringMap<double> BaseTimes;
+  for (const auto &Input : *BaseInputs) {
+    const json::Object *Obj = Input.getAsObject();
+    std::optional<StringRef> Name = Obj ? Obj->getString("name") : std::nullopt;
+    std::optional<double> Time = GetPhaseMedian(Input, "total");
+    if (Name && Time)
+      BaseTimes[*Name] = *Time;
+  }
+
+  bool Regressed = false;
+  OS << left_justify("input", 36) << right_justify("base (ms)", 13) << right_justify("new (ms)", 13)
+     << right_justify("change", 10) << "\n";
+  for (const auto &Input : Results) {
+    StringRef Name = *Input.getAsObject()->getString("name");
+    double Time = *GetPhaseMedian(Input, "total");
+    auto It = BaseTimes.find(Name);
+    if (It == BaseTimes.end()) {
+      OS << left_justify(Name, 36) << right_justify("-", 13) << format("%13.3f", Time) << right_justify("new", 10)
+         << "\n";
+      continue;
+    }
+    double Change = It->second > 0 ? (Time - It->second) / It->second * 100 : 0;
+    bool IsRegression = Change > Threshold;
+    Regressed |= IsRegression;
+    OS << left_justify(Name, 36) << format("%13.3f%13.3f%+9.1f%%", It->second, Time, Change)
+       << (IsRegression ? "  REGRESSION\n" : "\n");
+  }
+  return Regressed;
+}
+
+int main(int argc, char *argv[]) {
+  cl::ParseCommandLineOptions(argc, argv, "subc compile-time benchmark\n");
+
+  CompileOptions Opts;
+  if (!SetOptimizationLevel(Opts, OptLevel)) {
+    WithColor::error() << "invalid optimization level -O" << OptLevel << "\n";
+    return -1;
+  }
+  if (Iterations == 0) {
+    WithColor::error() << "-n must be at least 1\n";
+    return -1;
+  }
+
+  /// -scale 时只测量生成的程序，除非显式给出了输入
+  std::vector<BenchInput> BenchInputs;
+  if (!Scale.empty() && !AddScaleInputs(BenchInputs))
+    return -1;
+  if (Inputs.empty() && Scale.empty())
+    Inputs.push_back(SUBC_DEMO_DIR);
+  for (const auto &Input : Inputs)
+    if (!CollectInputs(Input, BenchInputs))
+      return -1;
+
+  if (SyntheticFunctions.empty() && Scale.empty()) {
+    SyntheticFunctions.push_back(100);
+    SyntheticFunctions.push_back(1000);
+  }
+  for (unsigned Functions : SyntheticFunctions) {
+    SyntheticOptions SynOpts;
+    SynOpts.functions = Functions;
+    BenchInputs.push_back({"synthetic/functions=" + std::to_string(Functions), GenerateSyntheticProgram(SynOpts)});
+  }
+
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  Opts.fileType = CodeGenFileType::ObjectFile;
+  Opts.includeDirs.push_back(SUBC_INCLUDE_DIR);
+  Driver D(Opts);
+  if (!D.InitTarget())
+    return -1;
+
+  json::Array Results;
+  std::vector<const BenchInput *> Measured;
+  std::vector<std::string> Skipped;
+  for (const auto &Input : BenchInputs) {
+    errs() << "subc-bench: " << Input.Name << "\n";
+    if (std::optional<json::Value> Result = RunInChild(Input, Opts)) {
+      Results.push_back(std::move(*Result));
+      Measured.push_back(&Input);
+    } else {
+      Skipped.push_back(Input.Name);
+    }
+  }
+  json::Array Scaling = GetScaling(Measured, Results, errs());
+
+  std::error_code EC;
+  raw_fd_ostream OS(OutputFilename, EC, sys::fs::OF_Text);
+  if (EC) {
+    WithColor::error() << "can't open file '" << OutputFilename << "'\n";
+    return -1;
+  }
+  json::OStream J(OS, 2);
+  J.object([&] {
+    J.attribute("llvm_version", LLVM_VERSION_STRING);
+    J.attribute("triple", D.GetTriple().normalize());
+    J.attribute("opt_level", std::string("O") + OptLevel.getValue());
+    J.attribute("iterations", (int64_t)Iterations);
+    J.attribute("inputs", json::Value(json::Array(Results)));
+    if (!Scaling.empty())
+      J.attribute("scaling", std::move(Scaling));
+    J.attributeArray("skipped", [&] {
+      for (const auto &Name : Skipped)
+        J.value(Name);
+    });
+  });
+  OS << "\n";
+
+  if (!Baseline.empty() && CompareWithBaseline(Results, errs()))
+    return 1;
+  return 0;
+}
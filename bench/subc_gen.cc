@@ -0,0 +1,49 @@
+/// subc-gen: 生成参数化的压力测试程序，用于测量编译时间随输入规模的变化
+/// ./bin/subc-gen -functions=5000 -nesting=200 -global-table=100000 -expr-chain=5000 -structs=2000 -o big.c
+#include "synthetic.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<std::string>
+OutputFilename("o", cl::desc("Output filename (default = stdout)"), cl::value_desc("filename"), cl::init("-"));
+
+static cl::opt<unsigned>
+Functions("functions", cl::desc("Number of functions with loops, branches and switches (default = 100)"),
+          cl::init(100));
+
+static cl::opt<unsigned>
+Nesting("nesting", cl::desc("Depth of nested if/while/for blocks in one function"), cl::init(0));
+
+static cl::opt<unsigned>
+GlobalTable("global-table", cl::desc("Number of elements in a global array initializer"), cl::init(0));
+
+static cl::opt<unsigned>
+ExprChain("expr-chain", cl::desc("Number of binary operators in one expression"), cl::init(0));
+
+static cl::opt<unsigned>
+Structs("structs", cl::desc("Number of struct types"), cl::init(0));
+
+int main(int argc, char *argv[]) {
+  cl::ParseCommandLineOptions(argc, argv, "subc stress program generator\n");
+
+  SyntheticOptions Opts;
+  Opts.functions = Functions;
+  Opts.nesting = Nesting;
+  Opts.globalTable = GlobalTable;
+  Opts.exprChain = ExprChain;
+  Opts.structs = Structs;
+
+  std::error_code EC;
+  raw_fd_ostream OS(OutputFilename, EC, sys::fs::OF_Text);
+  if (EC) {
+    WithColor::error() << "can't open file '" << OutputFilename << "'\n";
+    return -1;
+  }
+  OS << GenerateSyntheticProgram(Opts);
+  return 0;
+}
@@ -0,0 +1,171 @@
+#include "synthetic.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/raw_ostream.h"
+
+static const llvm::StringRef dimensions[] = {"functions", "nesting", "global-table", "expr-chain", "structs"};
+
+llvm::ArrayRef<llvm::StringRef> GetSyntheticDimensions() {
+    return dimensions;
+}
+
+bool SetSyntheticDimension(SyntheticOptions &opts, llvm::StringRef dimension, unsigned value) {
+    unsigned *field = llvm::StringSwitch<unsigned *>(dimension)
+        .Case("functions", &opts.functions)
+        .Case("nesting", &opts.nesting)
+        .Case("global-table", &opts.globalTable)
+        .Case("expr-chain", &opts.exprChain)
+        .Case("structs", &opts.structs)
+        .Default(nullptr);
+    if (!field) {
+        return false;
+    }
+    *field = value;
+    return true;
+}
+
+static void GenerateFunctions(llvm::raw_ostream &os, unsigned count) {
+    for (unsigned i = 0; i < count; ++i) {
+        os << "int f" << i << "(int n) {\n"
+           << "    int s = 0;\n"
+           << "    int a[16];\n"
+           << "    struct point p;\n"
+           << "    p.x = n; p.y = n * 2;\n"
+           << "    for (int i = 0; i < 16; i++) {\n"
+           << "        a[i] = i * " << (i % 13 + 1) << " + n;\n"
+           << "    }\n"
+           << "    for (int i = 0; i < n; i++) {\n"
+           << "        if (i % 3 == 0) {\n"
+           << "            s += a[i % 16];\n"
+           << "        } else if (i % 3 == 1) {\n"
+           << "            s -= i;\n"
+           << "        } else {\n"
+           << "            s = s ^ i;\n"
+           << "        }\n"
+           << "    }\n"
+           << "    while (s > 1000) {\n"
+           << "        s = s / 2;\n"
+           << "    }\n"
+           << "    switch (n & 3) {\n"
+           << "    case 0: s = s + p.x; break;\n"
+           << "    case 1: s = s - p.y; break;\n"
+           << "    default: s = s * 2; break;\n"
+           << "    }\n"
+           << "    return s + table[n & 3];\n"
+           << "}\n\n";
+    }
+}
+
+/// if/while/for 轮流嵌套，每层都声明一个局部变量
+static void GenerateNesting(llvm::raw_ostream &os, unsigned depth) {
+    os << "int nested(int n) {\n"
+       << "    int s = 0;\n";
+    for (unsigned i = 0; i < depth; ++i) {
+        os.indent(4 + i * 4);
+        switch (i % 3) {
+        case 0: os << "if (n > " << i << ") {\n"; break;
+        case 1: os << "while (s < " << i << ") {\n"; break;
+        default: os << "for (int i" << i << " = 0; i" << i << " < 2; i" << i << "++) {\n"; break;
+        }
+        os.indent(8 + i * 4) << "int v" << i << " = s + " << i << ";\n";
+        os.indent(8 + i * 4) << "s = v" << i << " + 1;\n";
+    }
+    for (unsigned i = depth; i > 0; --i) {
+        os.indent(i * 4) << "}\n";
+    }
+    os << "    return s;\n"
+       << "}\n\n";
+}
+
+/// 全局数组的初始化列表，每行 16 个常量
+static void GenerateGlobalTable(llvm::raw_ostream &os, unsigned size) {
+    os << "int gtable[" << size << "] = {";
+    for (unsigned i = 0; i < size; ++i) {
+        if (i % 16 == 0) {
+            os << "\n    ";
+        }
+        os << (i * 7919u % 65521u) << (i + 1 < size ? ", " : "");
+    }
+    os << "\n};\n\n";
+}
+
+/// 一个很长的左结合表达式: n + 3 * n - 5 ^ n ...
+static void GenerateExprChain(llvm::raw_ostream &os, unsigned length) {
+    static const char *ops[] = {" + ", " * ", " - ", " ^ ", " | ", " & "};
+    os << "int chain(int n) {\n"
+       << "    return n";
+    for (unsigned i = 0; i < length; ++i) {
+        os << ops[i % 6] << (i % 2 ? "n" : std::to_string(i % 97 + 1));
+        if (i % 16 == 15) {
+            os << "\n        ";
+        }
+    }
+    os << ";\n"
+       << "}\n\n";
+}
+
+/// 每个结构体有几个不同类型的成员，以及指向前一个结构体的指针，然后各定义一个全局变量
+static void GenerateStructs(llvm::raw_ostream &os, unsigned count) {
+    for (unsigned i = 0; i < count; ++i) {
+        os << "struct s" << i << " { int a; char b; int d[4];";
+        if (i > 0) {
+            os << " struct s" << i - 1 << " *prev;";
+        }
+        os << " };\n"
+           << "struct s" << i << " sv" << i << ";\n";
+    }
+    os << "int structs() {\n"
+       << "    int s = 0;\n";
+    for (unsigned i = 0; i < count; ++i) {
+        os << "    sv" << i << ".a = " << i << ";\n";
+        if (i > 0) {
+            os << "    sv" << i << ".prev = &sv" << i - 1 << ";\n";
+        }
+        os << "    s += sv" << i << ".a + sizeof(struct s" << i << ");\n";
+    }
+    os << "    return s;\n"
+       << "}\n\n";
+}
+
+std::string GenerateSyntheticProgram(const SyntheticOptions &opts) {
+    std::string out;
+    llvm::raw_string_ostream os(out);
+    os << "int printf(const char *fmt, ...);\n";
+    os << "struct point { int x; int y; };\n";
+    os << "int table[4] = {1, 2, 3, 4};\n\n";
+
+    GenerateFunctions(os, opts.functions);
+    if (opts.nesting) {
+        GenerateNesting(os, opts.nesting);
+    }
+    if (opts.globalTable) {
+        GenerateGlobalTable(os, opts.globalTable);
+    }
+    if (opts.exprChain) {
+        GenerateExprChain(os, opts.exprChain);
+    }
+    if (opts.structs) {
+        GenerateStructs(os, opts.structs);
+    }
+
+    os << "int main() {\n"
+       << "    int s = 0;\n";
+    for (unsigned i = 0; i < opts.functions; ++i) {
+        os << "    s += f" << i << "(" << (i % 32) << ");\n";
+    }
+    if (opts.nesting) {
+        os << "    s += nested(" << opts.nesting << ");\n";
+    }
+    if (opts.globalTable) {
+        os << "    s += gtable[" << opts.globalTable - 1 << "];\n";
+    }
+    if (opts.exprChain) {
+        os << "    s += chain(3);\n";
+    }
+    if (opts.structs) {
+        os << "    s += structs();\n";
+    }
+    os << "    printf(\"%d\\n\", s);\n"
+       << "    return 0;\n"
+       << "}\n";
+    return out;
+}
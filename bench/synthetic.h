@@ -0,0 +1,26 @@
+#pragma once
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include <string>
+
+/// 生成用于压力测试的 C 程序，所有输出都能被 subc 编译
+/// 每个维度生成各自独立的一部分代码，都由 main 调用，值为 0 时不生成
+struct SyntheticOptions {
+    /// 函数的个数，每个函数包含循环、分支、数组、结构体和 switch
+    unsigned functions{100};
+    /// 一个函数中 if/while/for 嵌套的层数
+    unsigned nesting{0};
+    /// 全局数组初始化列表的元素个数
+    unsigned globalTable{0};
+    /// 一个表达式中二元运算符的个数
+    unsigned exprChain{0};
+    /// 结构体类型的个数，每个结构体通过指针引用前一个
+    unsigned structs{0};
+};
+
+/// 可以扫描的维度，名字和命令行参数一致: functions, nesting, global-table, expr-chain, structs
+llvm::ArrayRef<llvm::StringRef> GetSyntheticDimensions();
+/// 按名字设置某个维度，名字不存在时返回 false
+bool SetSyntheticDimension(SyntheticOptions &opts, llvm::StringRef dimension, unsigned value);
+
+std::string GenerateSyntheticProgram(const SyntheticOptions &opts);
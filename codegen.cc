@@ -1,6 +1,9 @@
 #include "codegen.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/IR/Function.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/TimeProfiler.h"
 #include <cassert>
 
 using namespace llvm;
@@ -24,6 +27,7 @@ llvm::Value * CodeGen::VisitProgram(Program *p) {
 }
 
 llvm::Value * CodeGen::VisitBinaryExpr(BinaryExpr *binaryExpr) {
+    DebugLocScope locScope(this, binaryExpr);
     llvm::Value *left = nullptr;
     llvm::Value *right = nullptr;
     if (binaryExpr->op != BinaryOp::logical_or && binaryExpr->op != BinaryOp::logical_and) {
@@ -390,6 +394,10 @@ llvm::Value * CodeGen::VisitStringExpr(StringExpr *expr) {
 
 llvm::Value * CodeGen::VisitBlockStmt(BlockStmt *p) {
     PushScope();
+    bool hasDIScope = diBuilder && !diScopes.empty() && p->tok.row > 0;
+    if (hasDIScope) {
+        diScopes.push_back(diBuilder->createLexicalBlock(diScopes.back(), diFile, p->tok.row, p->tok.col));
+    }
     for (const auto &stmt : p->nodeVec) {
         stmt->Accept(this);
         if (llvm::dyn_cast<ReturnStmt>(stmt.get()) ||
@@ -398,6 +406,9 @@ llvm::Value * CodeGen::VisitBlockStmt(BlockStmt *p) {
                 break;
         }
     }
+    if (hasDIScope) {
+        diScopes.pop_back();
+    }
     PopScope();
     return nullptr;
 }
@@ -501,6 +512,7 @@ llvm::Value * CodeGen::VisitForStmt(ForStmt *p) {
 }
 
 llvm::Value * CodeGen::VisitContinueStmt(ContinueStmt *p) {
+    DebugLocScope locScope(this, p);
     /// jump incBB
     llvm::BasicBlock *bb = continueBBs[p->target.get()];
     irBuilder.CreateBr(bb);
@@ -508,6 +520,7 @@ llvm::Value * CodeGen::VisitContinueStmt(ContinueStmt *p) {
 }
 
 llvm::Value * CodeGen::VisitReturnStmt(ReturnStmt *p) {
+    DebugLocScope locScope(this, p);
     if (p->expr) {
         llvm::Value *val = p->expr->Accept(this);
         AssignCast(val, curFunc->getReturnType());
@@ -518,6 +531,7 @@ llvm::Value * CodeGen::VisitReturnStmt(ReturnStmt *p) {
 }
 
 llvm::Value * CodeGen::VisitBreakStmt(BreakStmt *p) {
+    DebugLocScope locScope(this, p);
     /// jump lastBB
     llvm::BasicBlock *bb = breakBBs[p->target.get()];
     irBuilder.CreateBr(bb);
@@ -647,6 +661,7 @@ llvm::Value * CodeGen::VisitDoWhileStmt(DoWhileStmt *p) {
 }
 
 llvm::Value * CodeGen::VisitVariableDecl(VariableDecl *decl) {
+    DebugLocScope locScope(this, decl);
     llvm::Type *ty = decl->ty->Accept(this);
     llvm::StringRef text(decl->tok.ptr, decl->tok.len);
 
@@ -716,6 +731,10 @@ llvm::Value * CodeGen::VisitVariableDecl(VariableDecl *decl) {
         llvm::GlobalVariable *globalVar = new llvm::GlobalVariable(*module, ty, false, llvm::GlobalValue::ExternalLinkage, nullptr, text);
         globalVar->setAlignment(llvm::Align(decl->ty->GetAlign()));
         globalVar->setInitializer(GetInitialValue(ty, GetInitialValue, {0}));
+        if (diBuilder) {
+            globalVar->addDebugInfo(diBuilder->createGlobalVariableExpression(
+                diCompileUnit, text, text, diFile, decl->tok.row, GetDIType(decl->ty.get()), false));
+        }
         AddGlobalVarToMap(globalVar, ty, text);
         return globalVar;
     }else {
@@ -725,6 +744,13 @@ llvm::Value * CodeGen::VisitVariableDecl(VariableDecl *decl) {
         alloc->setAlignment(llvm::Align(decl->ty->GetAlign()));
         AddLocalVarToMap(alloc, ty, text);
 
+        if (diBuilder && !diScopes.empty()) {
+            llvm::DILocalVariable *var = diBuilder->createAutoVariable(
+                diScopes.back(), text, diFile, decl->tok.row, GetDIType(decl->ty.get()), true);
+            diBuilder->insertDeclare(alloc, var, diBuilder->createExpression(), GetDILocation(decl->tok),
+                                     irBuilder.GetInsertBlock());
+        }
+
         if (decl->initValues.size() > 0) {
             if (decl->initValues.size() == 1) {
                 llvm::Value *initValue = decl->initValues[0]->value->Accept(this);
@@ -778,29 +804,64 @@ llvm::Value * CodeGen::VisitVariableDecl(VariableDecl *decl) {
     }
 }
 
+llvm::Function * CodeGen::GetOrDeclareFunction(CFuncType *cFuncTy) {
+    llvm::Function *func = module->getFunction(cFuncTy->GetName());
+    if (func) {
+        return func;
+    }
+    llvm::FunctionType * funcTy = llvm::dyn_cast<llvm::FunctionType>(cFuncTy->Accept(this));
+    func = Function::Create(funcTy, GlobalValue::ExternalLinkage, cFuncTy->GetName(), module.get());
+    AddGlobalVarToMap(func, funcTy, cFuncTy->GetName());
+
+    const auto &params = cFuncTy->GetParams();
+    int i = 0;
+    for (auto &arg : func->args()) {
+        arg.setName(params[i++].name);
+    }
+    return func;
+}
+
 llvm::Value * CodeGen::VisitFuncDecl(FuncDecl *decl) {
     ClearVarScope();
     CFuncType *cFuncTy = llvm::dyn_cast<CFuncType>(decl->ty.get());
     const auto &params = cFuncTy->GetParams();
-    llvm::Function *func = module->getFunction(cFuncTy->GetName());
-    
-    if (!func) {
-        /// main 
-        llvm::FunctionType * funcTy = llvm::dyn_cast<llvm::FunctionType>(decl->ty->Accept(this));
-        func = Function::Create(funcTy, GlobalValue::ExternalLinkage, cFuncTy->GetName(), module.get());
-        AddGlobalVarToMap(func, funcTy, cFuncTy->GetName());
-
-        int i = 0;
-        for (auto &arg : func->args()) {
-            arg.setName(params[i++].name);
-        }
-    }
+    llvm::Function *func = GetOrDeclareFunction(cFuncTy);
     if (!decl->blockStmt) {
         return nullptr;
     }
+    /// 只有声明的函数不能是 internal 的，在定义时设置
+    if (decl->isStatic) {
+        func->setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+
+    llvm::TimeTraceScope timeScope("CodeGen Function", cFuncTy->GetName());
+    llvm::TimeRecord startTime;
+    if (timeReport) {
+        startTime = llvm::TimeRecord::getCurrentTime(true);
+    }
+
+    /// 和 TargetMachine 保持一致，IR 层的 pass (比如向量化) 按函数属性查询 TTI
+    if (!options.cpu.empty()) {
+        func->addFnAttr("target-cpu", options.cpu);
+    }
+    if (!options.features.empty()) {
+        func->addFnAttr("target-features", options.features);
+    }
 
     BasicBlock *entryBB = BasicBlock::Create(context, "entry", func);
     irBuilder.SetInsertPoint(entryBB);
+
+    llvm::DISubprogram *subprogram = nullptr;
+    if (diBuilder) {
+        auto *diFuncTy = llvm::cast<llvm::DISubroutineType>(GetDIType(cFuncTy));
+        subprogram = diBuilder->createFunction(diFile, cFuncTy->GetName(), cFuncTy->GetName(), diFile, decl->tok.row,
+                                               diFuncTy, decl->tok.row, llvm::DINode::FlagPrototyped,
+                                               llvm::DISubprogram::SPFlagDefinition);
+        func->setSubprogram(subprogram);
+        diScopes.push_back(subprogram);
+        /// 参数的保存等 prologue 指令算在函数声明所在的行
+        irBuilder.SetCurrentDebugLocation(GetDILocation(decl->tok));
+    }
     /// 记录当前函数
     curFunc = func;
 
@@ -815,6 +876,12 @@ llvm::Value * CodeGen::VisitFuncDecl(FuncDecl *decl) {
 
         AddLocalVarToMap(alloc, arg.getType(), params[i].name);
 
+        if (subprogram) {
+            llvm::DILocalVariable *var = diBuilder->createParameterVariable(
+                subprogram, params[i].name, i + 1, diFile, decl->tok.row, GetDIType(params[i].type.get()), true);
+            diBuilder->insertDeclare(alloc, var, diBuilder->createExpression(), GetDILocation(decl->tok), entryBB);
+        }
+
         i++;
     }
 
@@ -840,16 +907,30 @@ llvm::Value * CodeGen::VisitFuncDecl(FuncDecl *decl) {
 
     PopScope();
 
+    if (subprogram) {
+        diScopes.clear();
+        irBuilder.SetCurrentDebugLocation(llvm::DebugLoc());
+        diBuilder->finalizeSubprogram(subprogram);
+    }
+
     // verifyFunction(*mFunc);
 
-    if (verifyModule(*module, &llvm::outs())) {
-        module->print(llvm::outs(), nullptr);
+    {
+        llvm::TimeRegion region(timeReport ? &timeReport->verifyTimer : nullptr);
+        llvm::TimeTraceScope verifyScope("VerifyModule", cFuncTy->GetName());
+        if (verifyModule(*module, &llvm::outs())) {
+            module->print(llvm::outs(), nullptr);
+        }
     }
 
+    if (timeReport) {
+        timeReport->RecordFunction(cFuncTy->GetName(), TimeReport::kCodeGen, startTime);
+    }
     return nullptr;
 }
 
 llvm::Value * CodeGen::VisitUnaryExpr(UnaryExpr *expr) {
+    DebugLocScope locScope(this, expr);
     llvm::Value *val = expr->node->Accept(this);
     llvm::Type *ty = expr->node->ty->Accept(this);
 
@@ -909,6 +990,7 @@ llvm::Value * CodeGen::VisitUnaryExpr(UnaryExpr *expr) {
 }
 
 llvm::Value * CodeGen::VisitCastExpr(CastExpr *expr) {
+    DebugLocScope locScope(this, expr);
     llvm::Type *ty = expr->targetType->Accept(this);
     llvm::Value *val = expr->node->Accept(this);
     AssignCast(val, ty);
@@ -927,6 +1009,7 @@ llvm::Value * CodeGen::VisitSizeOfExpr(SizeOfExpr *expr) {
 }
 
 llvm::Value * CodeGen::VisitPostIncExpr(PostIncExpr *expr) {
+    DebugLocScope locScope(this, expr);
     /// p++;
     /// p = p+1;
     llvm::Value *val = expr->left->Accept(this);
@@ -948,6 +1031,7 @@ llvm::Value * CodeGen::VisitPostIncExpr(PostIncExpr *expr) {
 }
 
 llvm::Value * CodeGen::VisitPostDecExpr(PostDecExpr *expr) {
+    DebugLocScope locScope(this, expr);
     llvm::Value *val = expr->left->Accept(this);
     llvm::Type *ty = expr->left->ty->Accept(this);
 
@@ -967,6 +1051,7 @@ llvm::Value * CodeGen::VisitPostDecExpr(PostDecExpr *expr) {
 }
 
 llvm::Value * CodeGen::VisitPostSubscript(PostSubscript *expr) {
+    DebugLocScope locScope(this, expr);
     llvm::Type *ty = expr->ty->Accept(this);
     llvm::Value *left = expr->left->Accept(this);
     llvm::Value *offset = expr->node->Accept(this);
@@ -985,6 +1070,7 @@ llvm::Value * CodeGen::VisitPostSubscript(PostSubscript *expr) {
 /// a.b 
 /// a -> T
 llvm::Value * CodeGen::VisitPostMemberDotExpr(PostMemberDotExpr *expr) {
+    DebugLocScope locScope(this, expr);
     llvm::Value *leftValue = expr->left->Accept(this);
     llvm::Type *leftType = expr->left->ty->Accept(this);
 
@@ -1008,6 +1094,7 @@ llvm::Value * CodeGen::VisitPostMemberDotExpr(PostMemberDotExpr *expr) {
 /// a->b
 /// ptr* -> ptr
 llvm::Value * CodeGen::VisitPostMemberArrowExpr(PostMemberArrowExpr *expr) {
+    DebugLocScope locScope(this, expr);
     llvm::Value *leftValue = expr->left->Accept(this);
     CPointType *cLeftPointerType = llvm::dyn_cast<CPointType>(expr->left->ty.get());
     
@@ -1029,6 +1116,7 @@ llvm::Value * CodeGen::VisitPostMemberArrowExpr(PostMemberArrowExpr *expr) {
 }
 
 llvm::Value * CodeGen::VisitPostFuncCall(PostFuncCall *expr) {
+    DebugLocScope locScope(this, expr);
     /// 求解出函数的地址
     llvm::Value *funcArr = expr->left->Accept(this);
     /// 求解出llvm的函数的类型，在语义模块，根据ptr to func，已调整成func类型
@@ -1056,6 +1144,7 @@ llvm::Value * CodeGen::VisitPostFuncCall(PostFuncCall *expr) {
 }
 
 llvm::Value * CodeGen::VisitThreeExpr(ThreeExpr *expr) {
+    DebugLocScope locScope(this, expr);
     llvm::Value *val = expr->cond->Accept(this);
     val = BoolCast(val);
 
@@ -1088,7 +1177,12 @@ llvm::Value * CodeGen::VisitThreeExpr(ThreeExpr *expr) {
 /// alloc T -> T *
 /// load T* -> T
 llvm::Value * CodeGen::VisitVariableAccessExpr(VariableAccessExpr *expr) {
+    DebugLocScope locScope(this, expr);
     llvm::StringRef text(expr->tok.ptr, expr->tok.len);
+    /// 预编译头中的函数没有 FuncDecl 结点，第一次使用时才声明
+    if (llvm::isa<CFuncType>(expr->ty.get()) && !FindVarByName(text)) {
+        return GetOrDeclareFunction(llvm::cast<CFuncType>(expr->ty.get()));
+    }
     const auto &[addr, ty] = GetVarByName(text);
     
     if (ty->isFunctionTy()) {
@@ -1170,14 +1264,21 @@ void CodeGen::AddGlobalVarToMap(llvm::Value *addr, llvm::Type *ty, llvm::StringR
     globalVarMap.insert({name, {addr, ty}});
 }
 
-std::pair<llvm::Value *, llvm::Type *> CodeGen::GetVarByName(llvm::StringRef name) {
+std::pair<llvm::Value *, llvm::Type *> *CodeGen::FindVarByName(llvm::StringRef name) {
     for (auto it = localVarMap.rbegin(); it != localVarMap.rend(); ++it) {
-        if (it->find(name) != it->end()) {
-            return (*it)[name];
+        auto var = it->find(name);
+        if (var != it->end()) {
+            return &var->second;
         }
     }
-    assert(globalVarMap.find(name) != globalVarMap.end());
-    return globalVarMap[name];
+    auto var = globalVarMap.find(name);
+    return var != globalVarMap.end() ? &var->second : nullptr;
+}
+
+std::pair<llvm::Value *, llvm::Type *> CodeGen::GetVarByName(llvm::StringRef name) {
+    auto *var = FindVarByName(name);
+    assert(var);
+    return *var;
 }
 
 void CodeGen::PushScope() {
@@ -1338,4 +1439,143 @@ llvm::Value *CodeGen::BoolCast(llvm::Value *val) {
     }else {
         return nullptr;
     }
-}
\ No newline at end of file
+}
+void CodeGen::InitDebugInfo(llvm::StringRef fileName) {
+    llvm::SmallString<128> dir;
+    if (llvm::sys::path::is_absolute(fileName)) {
+        dir = llvm::sys::path::parent_path(fileName);
+    }else {
+        llvm::sys::fs::current_path(dir);
+        llvm::sys::path::append(dir, llvm::sys::path::parent_path(fileName));
+    }
+
+    module->addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+    module->addModuleFlag(llvm::Module::Warning, "Dwarf Version", 5);
+
+    diBuilder = std::make_unique<llvm::DIBuilder>(*module);
+    diFile = diBuilder->createFile(llvm::sys::path::filename(fileName), dir);
+    diCompileUnit = diBuilder->createCompileUnit(llvm::dwarf::DW_LANG_C99, diFile, "subc", false, "", 0);
+}
+
+llvm::DILocation *CodeGen::GetDILocation(const Token &tok) {
+    return llvm::DILocation::get(context, tok.row, tok.col, diScopes.back());
+}
+
+/// CType -> DWARF 类型，void 对应 nullptr
+llvm::DIType *CodeGen::GetDIType(CType *ty) {
+    auto it = diTypes.find(ty);
+    if (it != diTypes.end()) {
+        return it->second;
+    }
+
+    llvm::DIType *diType = nullptr;
+    switch (ty->GetKind()) {
+    case CType::TY_Void:
+        return nullptr;
+    case CType::TY_Char:
+        diType = diBuilder->createBasicType("char", 8, llvm::dwarf::DW_ATE_signed_char);
+        break;
+    case CType::TY_UChar:
+        diType = diBuilder->createBasicType("unsigned char", 8, llvm::dwarf::DW_ATE_unsigned_char);
+        break;
+    case CType::TY_Short:
+        diType = diBuilder->createBasicType("short", 16, llvm::dwarf::DW_ATE_signed);
+        break;
+    case CType::TY_UShort:
+        diType = diBuilder->createBasicType("unsigned short", 16, llvm::dwarf::DW_ATE_unsigned);
+        break;
+    case CType::TY_Int:
+        diType = diBuilder->createBasicType("int", 32, llvm::dwarf::DW_ATE_signed);
+        break;
+    case CType::TY_UInt:
+        diType = diBuilder->createBasicType("unsigned int", 32, llvm::dwarf::DW_ATE_unsigned);
+        break;
+    case CType::TY_Long:
+        diType = diBuilder->createBasicType("long", ty->GetSize() * 8, llvm::dwarf::DW_ATE_signed);
+        break;
+    case CType::TY_ULong:
+        diType = diBuilder->createBasicType("unsigned long", ty->GetSize() * 8, llvm::dwarf::DW_ATE_unsigned);
+        break;
+    case CType::TY_LLong:
+        diType = diBuilder->createBasicType("long long", 64, llvm::dwarf::DW_ATE_signed);
+        break;
+    case CType::TY_ULLong:
+        diType = diBuilder->createBasicType("unsigned long long", 64, llvm::dwarf::DW_ATE_unsigned);
+        break;
+    case CType::TY_Float:
+        diType = diBuilder->createBasicType("float", 32, llvm::dwarf::DW_ATE_float);
+        break;
+    case CType::TY_Double:
+        diType = diBuilder->createBasicType("double", 64, llvm::dwarf::DW_ATE_float);
+        break;
+    case CType::TY_LDouble:
+        diType = diBuilder->createBasicType("long double", ty->GetSize() * 8, llvm::dwarf::DW_ATE_float);
+        break;
+    case CType::TY_Point: {
+        CPointType *pty = llvm::cast<CPointType>(ty);
+        diType = diBuilder->createPointerType(GetDIType(pty->GetBaseType().get()), ty->GetSize() * 8);
+        break;
+    }
+    case CType::TY_Array: {
+        CArrayType *aty = llvm::cast<CArrayType>(ty);
+        llvm::Metadata *subscript = diBuilder->getOrCreateSubrange(0, std::max(aty->GetElementCount(), 0));
+        diType = diBuilder->createArrayType(std::max(ty->GetSize(), 0) * 8, ty->GetAlign() * 8,
+                                            GetDIType(aty->GetElementType().get()),
+                                            diBuilder->getOrCreateArray(subscript));
+        break;
+    }
+    case CType::TY_Record: {
+        /// 先放入缓存再处理成员，支持 struct node { struct node *next; } 这样的自引用
+        CRecordType *rty = llvm::cast<CRecordType>(ty);
+        llvm::DICompositeType *composite;
+        if (rty->GetTagKind() == TagKind::kStruct) {
+            composite = diBuilder->createStructType(diCompileUnit, rty->GetName(), diFile, 0, ty->GetSize() * 8,
+                                                    ty->GetAlign() * 8, llvm::DINode::FlagZero, nullptr,
+                                                    llvm::DINodeArray());
+        }else {
+            composite = diBuilder->createUnionType(diCompileUnit, rty->GetName(), diFile, 0, ty->GetSize() * 8,
+                                                   ty->GetAlign() * 8, llvm::DINode::FlagZero, llvm::DINodeArray());
+        }
+        diTypes[ty] = composite;
+
+        llvm::SmallVector<llvm::Metadata *> elements;
+        for (const auto &member : rty->GetMembers()) {
+            elements.push_back(diBuilder->createMemberType(
+                composite, member.name, diFile, 0, member.ty->GetSize() * 8, member.ty->GetAlign() * 8,
+                member.offset * 8, llvm::DINode::FlagZero, GetDIType(member.ty.get())));
+        }
+        diBuilder->replaceArrays(composite, diBuilder->getOrCreateArray(elements));
+        return composite;
+    }
+    case CType::TY_Func: {
+        CFuncType *fty = llvm::cast<CFuncType>(ty);
+        llvm::SmallVector<llvm::Metadata *> types;
+        types.push_back(GetDIType(fty->GetRetType().get()));
+        for (const auto &param : fty->GetParams()) {
+            types.push_back(GetDIType(param.type.get()));
+        }
+        if (fty->IsVarArg()) {
+            types.push_back(diBuilder->createUnspecifiedParameter());
+        }
+        diType = diBuilder->createSubroutineType(diBuilder->getOrCreateTypeArray(types));
+        break;
+    }
+    }
+    diTypes[ty] = diType;
+    return diType;
+}
+
+CodeGen::DebugLocScope::DebugLocScope(CodeGen *cg, AstNode *node) {
+    if (!cg->diBuilder || cg->diScopes.empty() || node->tok.row <= 0) {
+        return;
+    }
+    this->cg = cg;
+    saved = cg->irBuilder.getCurrentDebugLocation();
+    cg->irBuilder.SetCurrentDebugLocation(cg->GetDILocation(node->tok));
+}
+
+CodeGen::DebugLocScope::~DebugLocScope() {
+    if (cg) {
+        cg->irBuilder.SetCurrentDebugLocation(saved);
+    }
+}
@@ -1,22 +1,44 @@
 #pragma once
 #include "ast.h"
 #include "parser.h"
+#include "time_report.h"
+#include "llvm/IR/DIBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/ADT/DenseMap.h"
 
+struct CodeGenOptions {
+    /// 写到每个函数定义的 target-cpu / target-features 属性上，为空时不设置
+    std::string cpu;
+    std::string features;
+    /// -g: 生成 DWARF 调试信息(行号表、函数、全局/局部变量)
+    bool debugInfo{false};
+};
+
 class CodeGen : public Visitor, public TypeVisitor {
 public:
-    CodeGen(std::shared_ptr<Program> p) {
+    CodeGen(std::shared_ptr<Program> p, TimeReport *timeReport = nullptr, const CodeGenOptions &options = {})
+        : timeReport(timeReport), options(options) {
         module = std::make_unique<llvm::Module>(p->fileName, context);
+        if (options.debugInfo) {
+            InitDebugInfo(p->fileName);
+        }
         VisitProgram(p.get());
+        if (diBuilder) {
+            diBuilder->finalize();
+        }
     }
 
     std::unique_ptr<llvm::Module> &GetModule() {
         return module;
     }
 
+    /// 交出 context 的所有权(比如交给 orc::ThreadSafeContext)，之后不能再使用该 CodeGen
+    std::unique_ptr<llvm::LLVMContext> TakeContext() {
+        return std::move(ownedContext);
+    }
+
 private:
     llvm::Value * VisitProgram(Program *p) override;
     llvm::Value * VisitBlockStmt(BlockStmt *p) override;
@@ -61,16 +83,48 @@ private:
     void AddLocalVarToMap(llvm::Value *addr, llvm::Type *ty, llvm::StringRef name);
     void AddGlobalVarToMap(llvm::Value *addr, llvm::Type *ty, llvm::StringRef name);
     std::pair<llvm::Value *, llvm::Type *> GetVarByName(llvm::StringRef name);
+    /// 没有找到时返回 nullptr
+    std::pair<llvm::Value *, llvm::Type *> *FindVarByName(llvm::StringRef name);
+    /// 函数第一次被声明或使用时创建
+    llvm::Function *GetOrDeclareFunction(CFuncType *cFuncTy);
 
     void PushScope();
     void PopScope();
     void ClearVarScope();
 
 private:
-    llvm::LLVMContext context;
+    /// 调试信息
+    void InitDebugInfo(llvm::StringRef fileName);
+    llvm::DIType *GetDIType(CType *ty);
+    llvm::DILocation *GetDILocation(const Token &tok);
+
+    /// 访问结点时把 irBuilder 的调试位置设为结点 token 的行列号，离开时恢复
+    /// 没有 token 的结点(row 为 0)沿用外层的位置
+    class DebugLocScope {
+    private:
+        CodeGen *cg{nullptr};
+        llvm::DebugLoc saved;
+    public:
+        DebugLocScope(CodeGen *cg, AstNode *node);
+        ~DebugLocScope();
+    };
+
+private:
+    std::unique_ptr<llvm::LLVMContext> ownedContext{std::make_unique<llvm::LLVMContext>()};
+    llvm::LLVMContext &context{*ownedContext};
     llvm::IRBuilder<> irBuilder{context};
     std::unique_ptr<llvm::Module> module;
     llvm::Function *curFunc{nullptr};
+    /// -ftime-report, 为空时不计时
+    TimeReport *timeReport{nullptr};
+    CodeGenOptions options;
+
+    std::unique_ptr<llvm::DIBuilder> diBuilder;
+    llvm::DICompileUnit *diCompileUnit{nullptr};
+    llvm::DIFile *diFile{nullptr};
+    /// 当前函数内的 subprogram 和 lexical block
+    llvm::SmallVector<llvm::DIScope *> diScopes;
+    llvm::DenseMap<CType *, llvm::DIType *> diTypes;
 
     llvm::DenseMap<AstNode *, llvm::BasicBlock *> breakBBs;
     llvm::DenseMap<AstNode *, llvm::BasicBlock *> continueBBs;
@@ -0,0 +1,95 @@
+#include "compile_cache.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/WithColor.h"
+
+CompileCache::CompileCache(llvm::StringRef dir, const llvm::CachePruningPolicy &policy) : dir(dir.str()), policy(policy) {}
+
+bool CompileCache::Init() {
+    if (std::error_code ec = llvm::sys::fs::create_directories(dir)) {
+        llvm::WithColor::error() << "can't create cache directory '" << dir << "': " << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+/// pruneCache 只会删除 llvmcache- 开头的文件
+std::string CompileCache::GetEntryPath(llvm::StringRef key) {
+    llvm::SmallString<128> path(dir);
+    llvm::sys::path::append(path, "llvmcache-" + key);
+    return std::string(path);
+}
+
+bool CompileCache::Lookup(llvm::StringRef key, llvm::StringRef output) {
+    /// OF_UpdateAtime 会更新访问时间，pruneCache 按访问时间淘汰最久没用过的缓存项
+    llvm::Expected<llvm::sys::fs::file_t> fd =
+        llvm::sys::fs::openNativeFileForRead(GetEntryPath(key), llvm::sys::fs::OF_UpdateAtime);
+    if (!fd) {
+        llvm::consumeError(fd.takeError());
+        misses++;
+        return false;
+    }
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buf =
+        llvm::MemoryBuffer::getOpenFile(*fd, GetEntryPath(key), -1, false);
+    llvm::sys::fs::closeFile(*fd);
+    if (!buf) {
+        misses++;
+        return false;
+    }
+
+    std::error_code ec;
+    llvm::raw_fd_ostream os(output, ec, llvm::sys::fs::OpenFlags::OF_None);
+    if (ec) {
+        misses++;
+        return false;
+    }
+    os << (*buf)->getBuffer();
+    /// 写入失败 (比如磁盘满) 时当作没有命中，重新编译; 不清除错误的话 raw_fd_ostream 析构时会 report_fatal_error
+    os.close();
+    if (os.has_error()) {
+        os.clear_error();
+        misses++;
+        return false;
+    }
+    hits++;
+    bytesRead += (*buf)->getBufferSize();
+    return true;
+}
+
+void CompileCache::Store(llvm::StringRef key, llvm::StringRef file) {
+    llvm::SmallString<128> tmpModel(dir);
+    llvm::sys::path::append(tmpModel, "tmp-%%%%%%%%");
+    llvm::SmallString<128> tmpPath;
+    if (llvm::sys::fs::createUniqueFile(tmpModel, tmpPath)) {
+        return;
+    }
+
+    uint64_t size = 0;
+    if (llvm::sys::fs::copy_file(file, tmpPath) || llvm::sys::fs::file_size(tmpPath, size) ||
+        llvm::sys::fs::rename(tmpPath, GetEntryPath(key))) {
+        llvm::sys::fs::remove(tmpPath);
+        return;
+    }
+    stores++;
+    bytesWritten += size;
+}
+
+void CompileCache::Prune() {
+    llvm::pruneCache(dir, policy);
+}
+
+void CompileCache::PrintStats(llvm::raw_ostream &os) {
+    uint64_t lookups = hits + misses;
+    os << "===-------------------------------------------------------------------------===\n";
+    os << "                              subc cache statistics\n";
+    os << "===-------------------------------------------------------------------------===\n";
+    os << "  directory  " << dir << "\n";
+    os << llvm::format("  hits       %12llu\n", (unsigned long long)hits);
+    os << llvm::format("  misses     %12llu\n", (unsigned long long)misses);
+    os << llvm::format("  hit rate   %12.1f %%\n", lookups ? 100.0 * hits / lookups : 0.0);
+    os << llvm::format("  stores     %12llu\n", (unsigned long long)stores);
+    os << llvm::format("  read       %12llu bytes\n", (unsigned long long)bytesRead);
+    os << llvm::format("  written    %12llu bytes\n", (unsigned long long)bytesWritten);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <string>
+
+/// 按内容寻址的编译缓存: key 是源码、target、优化级别等编译参数的哈希，value 是生成的汇编/目标文件
+/// 每个缓存项是目录下的一个文件，多个 subc 进程可以共享同一个目录
+class CompileCache {
+private:
+    std::string dir;
+    llvm::CachePruningPolicy policy;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> stores{0};
+    std::atomic<uint64_t> bytesRead{0};
+    std::atomic<uint64_t> bytesWritten{0};
+
+    std::string GetEntryPath(llvm::StringRef key);
+public:
+    CompileCache(llvm::StringRef dir, const llvm::CachePruningPolicy &policy);
+
+    /// 创建缓存目录，失败时打印错误
+    bool Init();
+
+    /// 命中时把缓存的文件拷贝到 output ("-" 表示 stdout)
+    bool Lookup(llvm::StringRef key, llvm::StringRef output);
+    /// 把 file 存入缓存，先写临时文件再 rename，并发写入同一个 key 也是安全的
+    void Store(llvm::StringRef key, llvm::StringRef file);
+
+    /// 按照 policy 删除过期的缓存项，使缓存大小不超过上限
+    void Prune();
+
+    void PrintStats(llvm::raw_ostream &os);
+};
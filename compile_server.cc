@@ -0,0 +1,292 @@
+#include "compile_server.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+/// 协议:
+///   client -> server: 1 字节 + SCM_RIGHTS(stdin, stdout, stderr)，工作目录，argc，argv[0..argc)
+///   server -> client: 4 字节的退出码
+/// 字符串都是 4 字节长度 + 内容
+static bool WriteAll(int fd, const void *data, size_t size) {
+    const char *p = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, void *data, size_t size) {
+    char *p = static_cast<char *>(data);
+    while (size > 0) {
+        ssize_t n = ::read(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool WriteString(int fd, llvm::StringRef str) {
+    uint32_t size = str.size();
+    return WriteAll(fd, &size, sizeof(size)) && WriteAll(fd, str.data(), size);
+}
+
+static bool ReadString(int fd, std::string &str) {
+    uint32_t size;
+    if (!ReadAll(fd, &size, sizeof(size))) {
+        return false;
+    }
+    str.resize(size);
+    return ReadAll(fd, str.data(), size);
+}
+
+static bool SendStdio(int fd) {
+    char tag = 'S';
+    iovec iov{&tag, 1};
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    return ::sendmsg(fd, &msg, 0) == 1;
+}
+
+static bool RecvStdio(int fd, int fds[3]) {
+    char tag;
+    iovec iov{&tag, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 3)] = {};
+
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(fd, &msg, 0) != 1) {
+        return false;
+    }
+    cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 3)) {
+        return false;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * 3);
+    return true;
+}
+
+static bool InitAddress(llvm::StringRef socketPath, sockaddr_un &addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        llvm::WithColor::error() << "socket path '" << socketPath << "' is too long\n";
+        return false;
+    }
+    memcpy(addr.sun_path, socketPath.data(), socketPath.size());
+    return true;
+}
+
+/// 在子进程中执行一个编译任务，不返回
+[[noreturn]] static void ServeConnection(int conn, llvm::function_ref<int(int argc, const char *const *argv)> compile) {
+    int fds[3];
+    std::string cwd;
+    uint32_t argc = 0;
+    std::vector<std::string> args;
+    bool ok = RecvStdio(conn, fds) && ReadString(conn, cwd) && ReadAll(conn, &argc, sizeof(argc));
+    for (uint32_t i = 0; ok && i < argc; ++i) {
+        args.emplace_back();
+        ok = ReadString(conn, args.back());
+    }
+    if (!ok || argc == 0) {
+        ::_exit(1);
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        ::dup2(fds[i], i);
+        ::close(fds[i]);
+    }
+    ::close(conn);
+    if (llvm::sys::fs::set_current_path(cwd)) {
+        llvm::WithColor::error() << "can't change directory to '" << cwd << "'\n";
+        ::_exit(1);
+    }
+
+    std::vector<const char *> argv;
+    for (const auto &arg : args) {
+        argv.push_back(arg.c_str());
+    }
+    argv.push_back(nullptr);
+    /// DiagEngine 报错时会直接 exit，退出码由父进程通过 waitpid 得到
+    int ret = compile(argc, argv.data());
+    llvm::outs().flush();
+    ::exit(ret);
+}
+
+static int sigchldPipe[2] = {-1, -1};
+
+static void OnSigChld(int) {
+    int savedErrno = errno;
+    char c = 0;
+    (void)!::write(sigchldPipe[1], &c, 1);
+    errno = savedErrno;
+}
+
+int RunCompileServer(llvm::StringRef socketPath, llvm::function_ref<int(int argc, const char *const *argv)> compile) {
+    sockaddr_un addr;
+    if (!InitAddress(socketPath, addr)) {
+        return -1;
+    }
+    int listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        llvm::WithColor::error() << "can't create socket: " << strerror(errno) << "\n";
+        return -1;
+    }
+    ::unlink(addr.sun_path);
+    if (::bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(listenFd, 128) < 0) {
+        llvm::WithColor::error() << "can't listen on '" << socketPath << "': " << strerror(errno) << "\n";
+        ::close(listenFd);
+        return -1;
+    }
+
+    /// 子进程退出时通过 self-pipe 唤醒 poll，再把退出码发给对应的客户端
+    if (::pipe2(sigchldPipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        llvm::WithColor::error() << "can't create pipe: " << strerror(errno) << "\n";
+        return -1;
+    }
+    struct sigaction sa{};
+    sa.sa_handler = OnSigChld;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    ::sigaction(SIGCHLD, &sa, nullptr);
+    ::signal(SIGPIPE, SIG_IGN);
+
+    llvm::errs() << "subc: compile server listening on " << socketPath << "\n";
+
+    std::map<pid_t, int> jobs;
+    while (true) {
+        pollfd pfds[2] = {{listenFd, POLLIN, 0}, {sigchldPipe[0], POLLIN, 0}};
+        if (::poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            char buf[64];
+            while (::read(sigchldPipe[0], buf, sizeof(buf)) > 0) {
+            }
+            int status;
+            pid_t pid;
+            while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0) {
+                auto it = jobs.find(pid);
+                if (it == jobs.end()) {
+                    continue;
+                }
+                int32_t ret = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                WriteAll(it->second, &ret, sizeof(ret));
+                ::close(it->second);
+                jobs.erase(it);
+            }
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int conn = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (conn < 0) {
+                continue;
+            }
+            llvm::outs().flush();
+            pid_t pid = ::fork();
+            if (pid == 0) {
+                ::close(listenFd);
+                ::close(sigchldPipe[0]);
+                ::close(sigchldPipe[1]);
+                ::signal(SIGCHLD, SIG_DFL);
+                ::signal(SIGPIPE, SIG_DFL);
+                ServeConnection(conn, compile);
+            }
+            if (pid < 0) {
+                llvm::WithColor::error() << "fork failed: " << strerror(errno) << "\n";
+                ::close(conn);
+                continue;
+            }
+            jobs[pid] = conn;
+        }
+    }
+    ::close(listenFd);
+    return -1;
+}
+
+int RunCompileClient(llvm::StringRef socketPath, int argc, const char *const *argv) {
+    sockaddr_un addr;
+    if (!InitAddress(socketPath, addr)) {
+        return -1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        llvm::WithColor::error() << "can't connect to compile server '" << socketPath << "': " << strerror(errno) << "\n";
+        return -1;
+    }
+
+    llvm::SmallString<128> cwd;
+    llvm::sys::fs::current_path(cwd);
+    uint32_t count = argc;
+    bool ok = SendStdio(fd) && WriteString(fd, cwd) && WriteAll(fd, &count, sizeof(count));
+    for (int i = 0; ok && i < argc; ++i) {
+        ok = WriteString(fd, argv[i]);
+    }
+
+    int32_t ret;
+    if (!ok || !ReadAll(fd, &ret, sizeof(ret))) {
+        llvm::WithColor::error() << "lost connection to compile server '" << socketPath << "'\n";
+        ::close(fd);
+        return -1;
+    }
+    ::close(fd);
+    return ret;
+}
+#else
+int RunCompileServer(llvm::StringRef socketPath, llvm::function_ref<int(int argc, const char *const *argv)> compile) {
+    llvm::WithColor::error() << "compile server is not supported on this platform\n";
+    return -1;
+}
+
+int RunCompileClient(llvm::StringRef socketPath, int argc, const char *const *argv) {
+    llvm::WithColor::error() << "compile server is not supported on this platform\n";
+    return -1;
+}
+#endif
@@ -0,0 +1,11 @@
+#pragma once
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
+
+/// 常驻的编译服务: 启动时初始化一次所有 target，之后通过 unix domain socket 接收编译任务
+/// 每个任务在 fork 出的子进程中执行，子进程继承已经初始化好的 target 和预先创建的 TargetMachine，并使用客户端的 stdin/stdout/stderr 和工作目录
+/// 返回值是服务异常退出时的错误码
+int RunCompileServer(llvm::StringRef socketPath, llvm::function_ref<int(int argc, const char *const *argv)> compile);
+
+/// 把 argv、工作目录和 stdin/stdout/stderr 转发给编译服务，返回编译的退出码
+int RunCompileClient(llvm::StringRef socketPath, int argc, const char *const *argv);
@@ -1,7 +1,4 @@
-int printf(const char *fmg, ...);
-int scanf(const char *format, ...);
-int getchar();
-int putchar(int ch);
+#include <stdio.h>
 
 int getint() {
   int val;
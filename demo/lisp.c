@@ -6,10 +6,7 @@
 // Error handling
 // ======================================================================
 
-int printf(const char *fmg, ...);
-int scanf(const char *format, ...);
-int getchar();
-int putchar(int ch);
+#include <stdio.h>
 
 int getint() {
   int val;
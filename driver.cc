@@ -0,0 +1,612 @@
+#include "driver.h"
+#include "codegen.h"
+#include "compile_cache.h"
+#include "diag_engine.h"
+#include "lexer.h"
+#include "linker.h"
+#include "parser.h"
+#include "preprocessor.h"
+#include "sema.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/CodeGen/ParallelCG.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/TargetProcess/TargetExecutionUtils.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/StandardInstrumentations.h"
+#include "llvm/Support/BLAKE3.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/TargetParser/Host.h"
+#include "llvm/TargetParser/SubtargetFeature.h"
+
+#include <algorithm>
+#include <cassert>
+#include <optional>
+
+std::string TargetMachineCache::GetKey(llvm::StringRef triple, llvm::StringRef cpu, llvm::StringRef features,
+                                       llvm::CodeGenOptLevel level) {
+    return (triple + "\n" + cpu + "\n" + features + "\n" + llvm::Twine(static_cast<int>(level))).str();
+}
+
+void TargetMachineCache::Add(std::unique_ptr<llvm::TargetMachine> tm) {
+    std::string key = GetKey(tm->getTargetTriple().str(), tm->getTargetCPU(), tm->getTargetFeatureString(),
+                             tm->getOptLevel());
+    std::lock_guard<std::mutex> lock(mutex);
+    machines[key] = std::move(tm);
+}
+
+std::unique_ptr<llvm::TargetMachine> TargetMachineCache::Take(llvm::StringRef triple, llvm::StringRef cpu,
+                                                              llvm::StringRef features, llvm::CodeGenOptLevel level) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = machines.find(GetKey(triple, cpu, features, level));
+    if (it == machines.end()) {
+        return nullptr;
+    }
+    std::unique_ptr<llvm::TargetMachine> tm = std::move(it->second);
+    machines.erase(it);
+    return tm;
+}
+
+bool SetOptimizationLevel(CompileOptions &opts, char level) {
+    switch (level) {
+    case '0':
+        opts.optLevel = llvm::OptimizationLevel::O0;
+        opts.codeGenOptLevel = llvm::CodeGenOptLevel::None;
+        return true;
+    case '1':
+        opts.optLevel = llvm::OptimizationLevel::O1;
+        opts.codeGenOptLevel = llvm::CodeGenOptLevel::Less;
+        return true;
+    case '2':
+        opts.optLevel = llvm::OptimizationLevel::O2;
+        opts.codeGenOptLevel = llvm::CodeGenOptLevel::Default;
+        return true;
+    case '3':
+        opts.optLevel = llvm::OptimizationLevel::O3;
+        opts.codeGenOptLevel = llvm::CodeGenOptLevel::Aggressive;
+        return true;
+    case 's':
+        opts.optLevel = llvm::OptimizationLevel::Os;
+        opts.codeGenOptLevel = llvm::CodeGenOptLevel::Default;
+        return true;
+    case 'z':
+        opts.optLevel = llvm::OptimizationLevel::Oz;
+        opts.codeGenOptLevel = llvm::CodeGenOptLevel::Default;
+        return true;
+    default:
+        return false;
+    }
+}
+
+Driver::Driver(const CompileOptions &opts, CompileCache *cache, TargetMachineCache *machines)
+    : opts(opts), cache(cache), machines(machines) {
+    if (opts.triple.empty()) {
+        triple.setTriple(llvm::sys::getDefaultTargetTriple());
+    }else {
+        triple.setTriple(llvm::Triple::normalize(opts.triple));
+    }
+}
+
+bool Driver::InitTarget() {
+    std::string err;
+    target = llvm::TargetRegistry::lookupTarget(triple.normalize(), err);
+    if (!target) {
+        llvm::WithColor::error() << "target lookup failed with error: " << err << "\n";
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<llvm::TargetMachine> Driver::CreateTargetMachine() {
+    if (machines) {
+        if (auto tm = machines->Take(triple.normalize(), opts.cpu, opts.features, opts.codeGenOptLevel)) {
+            return tm;
+        }
+    }
+    return std::unique_ptr<llvm::TargetMachine>(
+        target->createTargetMachine(triple.normalize(), opts.cpu, opts.features, {}, llvm::Reloc::Model::Static, {}, opts.codeGenOptLevel));
+}
+
+std::unique_ptr<llvm::TargetMachine> Driver::CreateTargetMachine(llvm::Module &module) {
+    auto tm = CreateTargetMachine(module);
+    return tm;
+}
+
+std::unique_ptr<llvm::MemoryBuffer> Driver::ReadSource(llvm::StringRef input) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buf = llvm::MemoryBuffer::getFileOrSTDIN(input);
+    if (!buf) {
+        llvm::WithColor::error() << "can't open file '" << input << "'\n";
+        return nullptr;
+    }
+    llvm::StringRef content = (*buf)->getBuffer();
+    numFiles++;
+    numBytes += content.size();
+    numLines += content.count('\n');
+    return std::move(*buf);
+}
+
+/// 影响预处理结果的选项，生成和使用预编译头时必须相同
+static std::vector<std::string> GetPCHOptions(const CompileOptions &opts) {
+    std::vector<std::string> options;
+    for (const auto &define : opts.defines) {
+        options.push_back("-D" + define);
+    }
+    for (const auto &dir : opts.includeDirs) {
+        options.push_back("-I" + dir);
+    }
+    return options;
+}
+
+bool Driver::LoadPCH() {
+    pch = PCHFile::Open(opts.includePCH, GetPCHOptions(opts));
+    return pch != nullptr;
+}
+
+/// 源码之外，所有会影响输出的选项都要参与哈希
+/// 输入路径会写进 module 的 source_filename; -g 时相对路径还要加上工作目录，DIFile 中记录的是它们
+std::string Driver::GetCacheKey(llvm::StringRef input, llvm::StringRef source,
+                                llvm::ArrayRef<std::string> includedFiles) {
+    llvm::BLAKE3 hasher;
+    auto addField = [&hasher](llvm::StringRef field) {
+        hasher.update(field);
+        hasher.update(llvm::StringRef("\0", 1));
+    };
+    addField("subc-cache-v1");
+    addField(LLVM_VERSION_STRING);
+    addField(triple.normalize());
+    addField(opts.cpu);
+    addField(opts.features);
+    addField(std::to_string(opts.optLevel.getSpeedupLevel()));
+    addField(std::to_string(opts.optLevel.getSizeLevel()));
+    addField(std::to_string(static_cast<int>(opts.codeGenOptLevel)));
+    addField(std::to_string(static_cast<int>(opts.fileType)));
+    addField(std::to_string(opts.codegenPartitions));
+    addField(std::to_string(opts.debugInfo));
+    addField(std::to_string(opts.pgoAction));
+    addField(opts.profileFile);
+    for (const auto &dir : opts.includeDirs) {
+        addField(dir);
+    }
+    for (const auto &define : opts.defines) {
+        addField(define);
+    }
+    if (pch) {
+        addField(pch->GetBuffer());
+    }
+    if (opts.pgoAction == llvm::PGOOptions::IRUse) {
+        if (auto profile = llvm::MemoryBuffer::getFile(opts.profileFile)) {
+            addField((*profile)->getBuffer());
+        }
+    }
+    addField(input);
+    if (opts.debugInfo) {
+        llvm::SmallString<128> cwd;
+        if (!llvm::sys::fs::current_path(cwd)) {
+            addField(cwd);
+        }
+    }
+    addField(source);
+    /// 与预处理时读到的是同一份内容 (HeaderCache 只读取一次)
+    std::vector<std::string> headers(includedFiles.begin(), includedFiles.end());
+    llvm::sort(headers);
+    for (const auto &path : headers) {
+        addField(path);
+        if (const CachedHeader *header = headerCache.Get(path)) {
+            addField(header->buffer->getBuffer());
+        }
+    }
+    return llvm::toHex(hasher.final(), true);
+}
+
+bool Driver::GenerateModule(std::unique_ptr<llvm::MemoryBuffer> buf, ModuleUnit &unit, TimeReport *timeReport,
+                            MemReport *memReport, llvm::function_ref<bool(const Preprocessor &)> afterPreprocess) {
+    llvm::TimeTraceScope timeScope("Frontend", buf->getBufferIdentifier());
+
+    llvm::SourceMgr mgr;
+    DiagEngine diagEngine(mgr);
+    mgr.AddNewSourceBuffer(std::move(buf), llvm::SMLoc());
+
+    Lexer lexer(mgr, diagEngine);
+    lexer.SetParallel(opts.lexThreads);
+    /// 预编译头中的符号在第一次被查找时才反序列化
+    std::optional<PCHReader> pchReader;
+    Sema sema(diagEngine);
+    if (pch) {
+        pchReader.emplace(*pch);
+        sema.SetExternalSource(&*pchReader);
+    }
+    std::shared_ptr<Program> program;
+    {
+        std::vector<Token> tokens;
+        {
+            llvm::TimeRegion region(timeReport ? &timeReport->lexTimer : nullptr);
+            Preprocessor preprocessor(lexer, headerCache, opts.includeDirs, opts.defines);
+            if (pch) {
+                preprocessor.AddPrecompiled(pch->macros, pch->includedFiles);
+            }
+            preprocessor.Tokenize(tokens);
+            unit.numTokens = tokens.size();
+            if (afterPreprocess && afterPreprocess(preprocessor)) {
+                return true;
+            }
+        }
+        Parser parser(lexer, sema, std::move(tokens), timeReport);
+        llvm::TimeRegion region(timeReport ? &timeReport->parseTimer : nullptr);
+        program = parser.ParseProgram();
+    }
+    if (memReport) {
+        memReport->RecordFrontend(sema);
+        memReport->EndPhase(MemReport::kParse);
+    }
+    llvm::TimeRegion region(timeReport ? &timeReport->codegenTimer : nullptr);
+    CodeGen codegen(program, timeReport, {opts.cpu, opts.features, opts.debugInfo});
+    if (memReport) {
+        memReport->RecordModule(*codegen.GetModule());
+        memReport->EndPhase(MemReport::kCodeGen);
+    }
+
+    unit.module = std::move(codegen.GetModule());
+    unit.context = codegen.TakeContext();
+    return true;
+}
+
+/// 使用 new PassManager 构建默认的 module pipeline (mem2reg, inline, loop, vectorize ...)
+void Driver::OptimizeModule(llvm::Module &module, llvm::TargetMachine *tm) {
+    llvm::LoopAnalysisManager lam;
+    llvm::FunctionAnalysisManager fam;
+    llvm::CGSCCAnalysisManager cgam;
+    llvm::ModuleAnalysisManager mam;
+
+    /// 开启 -ftime-trace 时，StandardInstrumentations 会记录每个 pass 的耗时
+    llvm::PassInstrumentationCallbacks pic;
+    llvm::StandardInstrumentations si(module.getContext(), false);
+    si.registerCallbacks(pic, &mam);
+
+    std::optional<llvm::PGOOptions> pgoOpt;
+    if (opts.pgoAction != llvm::PGOOptions::NoAction) {
+        pgoOpt = llvm::PGOOptions(opts.profileFile, "", "", "", llvm::vfs::getRealFileSystem(), opts.pgoAction);
+    }
+
+    llvm::PassBuilder pb(tm, llvm::PipelineTuningOptions(), pgoOpt, &pic);
+    pb.registerModuleAnalyses(mam);
+    pb.registerCGSCCAnalyses(cgam);
+    pb.registerFunctionAnalyses(fam);
+    pb.registerLoopAnalyses(lam);
+    pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+    llvm::ModulePassManager mpm = pb.buildPerModuleDefaultPipeline(opts.optLevel);
+    mpm.run(module, mam);
+}
+
+/// 通过 target machine 来串联 输入(module)和输出(汇编文件 或 目标文件)
+bool Driver::EmitFile(llvm::Module &module, llvm::TargetMachine *tm, llvm::StringRef output) {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(output, ec, llvm::sys::fs::OpenFlags::OF_None);
+    if (ec) {
+        llvm::WithColor::error() << "Can not open file '" << output << "'\n";
+        return false;
+    }
+
+    llvm::legacy::PassManager pm;
+    if (tm->addPassesToEmitFile(pm, os, nullptr, opts.fileType)) {
+        llvm::WithColor::error() << "No support for file type\n";
+        return false;
+    }
+    pm.run(module);
+    return true;
+}
+
+/// 拆分成多个分区后并行生成目标文件，最后合并成一个可重定位目标文件
+bool Driver::EmitFileParallel(llvm::Module &module, llvm::StringRef output) {
+    std::vector<std::string> partFiles;
+    std::vector<std::unique_ptr<llvm::raw_fd_ostream>> streams;
+    std::vector<llvm::raw_pwrite_stream *> oss;
+    bool ok = true;
+    for (unsigned i = 0; i < opts.codegenPartitions; ++i) {
+        llvm::SmallString<128> path;
+        if (llvm::sys::fs::createTemporaryFile("subc-part", "o", path)) {
+            llvm::WithColor::error() << "Can not create temporary file\n";
+            ok = false;
+            break;
+        }
+        std::error_code ec;
+        streams.push_back(std::make_unique<llvm::raw_fd_ostream>(path, ec, llvm::sys::fs::OpenFlags::OF_None));
+        partFiles.push_back(std::string(path));
+        if (ec) {
+            llvm::WithColor::error() << "Can not open file '" << path << "'\n";
+            ok = false;
+            break;
+        }
+        oss.push_back(streams.back().get());
+    }
+
+    if (ok) {
+        /// PreserveLocals: 否则 static 函数和字符串常量会被改成 hidden 的全局符号，ld -r 之后仍然是全局的，
+        /// 两个这样编译的编译单元链接到一起时会因为 __llvmsplit_unnamed 等符号重复定义而失败
+        llvm::splitCodeGen(module, oss, {}, [this]() { return CreateTargetMachine(); }, opts.fileType,
+                           /*PreserveLocals=*/true);
+        streams.clear();
+        ok = LinkRelocatable(triple, partFiles, output);
+    }
+
+    for (const auto &file : partFiles) {
+        llvm::sys::fs::remove(file);
+    }
+    return ok;
+}
+
+bool Driver::CompileFile(llvm::StringRef input, llvm::StringRef output) {
+    /// profiler 是 thread local 的，线程池中每个文件各自记录
+    if (opts.timeTrace) {
+        llvm::timeTraceProfilerInitialize(opts.timeTraceGranularity, "subc");
+    }
+    std::unique_ptr<TimeReport> timeReport;
+    if (opts.timeReport) {
+        timeReport = std::make_unique<TimeReport>(input);
+    }
+    std::unique_ptr<MemReport> memReport;
+    if (opts.memReport) {
+        memReport = std::make_unique<MemReport>(input);
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> buf = ReadSource(input);
+    if (!buf) {
+        WriteTimeTrace(input, output);
+        return false;
+    }
+
+    /// 命中缓存时不需要解析、生成代码和跑后端; 输出到 stdout 时无法回读，-print-ir 需要生成 IR, 都不缓存
+    /// 有预处理指令时，预处理之后才知道包含了哪些头文件，它们的路径和内容也要参与哈希
+    std::string cacheKey;
+    bool useCache = cache && output != "-" && !opts.printIR;
+    llvm::StringRef source = buf->getBuffer();
+    auto lookupCache = [&](const Preprocessor &preprocessor) {
+        cacheKey = GetCacheKey(input, source, preprocessor.GetIncludedFiles());
+        return cache->Lookup(cacheKey, output);
+    };
+
+    /// 没有预处理指令、-D 和预编译头时不会包含头文件，在词法分析之前就用源码算出 key, 命中时连 Lexer 也不用跑
+    bool plainSource = Preprocessor::IsPlainSource(source, !opts.defines.empty() || pch);
+    if (useCache && plainSource) {
+        cacheKey = GetCacheKey(input, source, {});
+        if (cache->Lookup(cacheKey, output)) {
+            WriteTimeTrace(input, output);
+            return true;
+        }
+    }
+
+    ModuleUnit unit;
+    if (!GenerateModule(std::move(buf), unit, timeReport.get(), memReport.get(),
+                        useCache && !plainSource ? llvm::function_ref<bool(const Preprocessor &)>(lookupCache)
+                                                 : nullptr)) {
+        WriteTimeTrace(input, output);
+        return false;
+    }
+    if (!unit.module) {
+        WriteTimeTrace(input, output);
+        return true;
+    }
+    llvm::Module &module = *unit.module;
+
+    auto tm = CreateTargetMachine();
+    module.setTargetTriple(triple.normalize());
+    module.setDataLayout(tm->createDataLayout());
+
+    if (opts.printIR) {
+        std::lock_guard<std::mutex> lock(outsMutex);
+        module.print(llvm::outs(), nullptr);
+    }
+    assert(!llvm::verifyModule(module));
+
+    /// -O0 不跑任何 pass, 除非需要插桩
+    if (opts.optLevel != llvm::OptimizationLevel::O0 || opts.pgoAction == llvm::PGOOptions::IRInstr) {
+        llvm::TimeTraceScope timeScope("Optimizer");
+        llvm::TimeRegion region(timeReport ? &timeReport->optTimer : nullptr);
+        OptimizeModule(module, tm.get());
+        if (memReport) {
+            memReport->EndPhase(MemReport::kOpt);
+        }
+    }
+
+    bool ok;
+    {
+        llvm::TimeTraceScope timeScope("Backend");
+        llvm::TimeRegion region(timeReport ? &timeReport->backendTimer : nullptr);
+        /// 汇编文件无法简单合并，只有目标文件才拆分
+        if (opts.codegenPartitions > 1 && opts.fileType == llvm::CodeGenFileType::ObjectFile) {
+            ok = EmitFileParallel(module, output);
+        }else {
+            ok = EmitFile(module, tm.get(), output);
+        }
+    }
+    if (memReport) {
+        memReport->EndPhase(MemReport::kBackend);
+    }
+
+    if (ok && useCache) {
+        cache->Store(cacheKey, output);
+    }
+
+    if (timeReport) {
+        PrintTimeReport(*timeReport);
+    }
+    if (memReport) {
+        PrintMemReport(*memReport);
+    }
+    WriteTimeTrace(input, output);
+    return ok;
+}
+
+bool Driver::CompileFiles(llvm::ArrayRef<std::string> inputs, llvm::ArrayRef<std::string> outputs, unsigned threads) {
+    assert(inputs.size() == outputs.size());
+    if (inputs.size() == 1) {
+        return CompileFile(inputs[0], outputs[0]);
+    }
+
+    std::atomic<bool> ok{true};
+    llvm::DefaultThreadPool pool(llvm::hardware_concurrency(threads));
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        pool.async([this, &ok, &inputs, &outputs, i]() {
+            if (!CompileFile(inputs[i], outputs[i])) {
+                ok = false;
+            }
+        });
+    }
+    pool.wait();
+    return ok;
+}
+
+/// 每个函数先生成一个 stub，第一次被调用时才真正编译，大程序不用等全部函数 codegen 完就能开始执行
+int Driver::RunWithJIT(llvm::StringRef input) {
+    auto exitOnErr = llvm::ExitOnError("subc: ");
+
+    /// profiler 是 thread local 的，线程池中每个文件各自记录
+    if (opts.timeTrace) {
+        llvm::timeTraceProfilerInitialize(opts.timeTraceGranularity, "subc");
+    }
+    std::unique_ptr<TimeReport> timeReport;
+    if (opts.timeReport) {
+        timeReport = std::make_unique<TimeReport>(input);
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> buf = ReadSource(input);
+    ModuleUnit unit;
+    if (!buf || !GenerateModule(std::move(buf), unit, timeReport.get())) {
+        WriteTimeTrace(input);
+        return -1;
+    }
+    assert(!llvm::verifyModule(*unit.module));
+
+    auto jtmb = exitOnErr(llvm::orc::JITTargetMachineBuilder::detectHost());
+    jtmb.setCodeGenOptLevel(opts.codeGenOptLevel);
+    jtmb.setCPU(opts.cpu);
+    jtmb.getFeatures() = llvm::SubtargetFeatures(opts.features);
+
+    if (opts.optLevel != llvm::OptimizationLevel::O0) {
+        auto tm = exitOnErr(jtmb.createTargetMachine());
+        unit.module->setTargetTriple(tm->getTargetTriple().str());
+        unit.module->setDataLayout(tm->createDataLayout());
+        llvm::TimeTraceScope timeScope("Optimizer");
+        llvm::TimeRegion region(timeReport ? &timeReport->optTimer : nullptr);
+        OptimizeModule(*unit.module, tm.get());
+    }
+
+    /// 函数在第一次调用时才编译，后端的耗时算在程序运行中，不在报告里
+    if (timeReport) {
+        PrintTimeReport(*timeReport);
+    }
+    WriteTimeTrace(input);
+
+    auto jit = exitOnErr(llvm::orc::LLLazyJITBuilder().setJITTargetMachineBuilder(std::move(jtmb)).create());
+    unit.module->setDataLayout(jit->getDataLayout());
+
+    /// printf/scanf 等外部符号从当前进程中查找
+    jit->getMainJITDylib().addGenerator(exitOnErr(
+        llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(jit->getDataLayout().getGlobalPrefix())));
+
+    exitOnErr(jit->addLazyIRModule(llvm::orc::ThreadSafeModule(std::move(unit.module), std::move(unit.context))));
+
+    auto mainAddr = exitOnErr(jit->lookup("main"));
+    auto *mainFn = mainAddr.toPtr<int (*)(int, char *[])>();
+    return llvm::orc::runAsMain(mainFn, {}, input);
+}
+
+bool Driver::EmitPCH(llvm::StringRef input, llvm::StringRef output) {
+    std::unique_ptr<llvm::MemoryBuffer> buf = ReadSource(input);
+    if (!buf) {
+        return false;
+    }
+    llvm::SourceMgr mgr;
+    DiagEngine diagEngine(mgr);
+    mgr.AddNewSourceBuffer(std::move(buf), llvm::SMLoc());
+
+    Lexer lexer(mgr, diagEngine);
+    Sema sema(diagEngine);
+    Preprocessor preprocessor(lexer, headerCache, opts.includeDirs, opts.defines);
+    std::vector<Token> tokens;
+    preprocessor.Tokenize(tokens);
+    Parser parser(lexer, sema, std::move(tokens));
+    auto program = parser.ParseProgram();
+
+    /// 变量和函数定义会在每个使用预编译头的编译单元中重复生成，只允许声明
+    for (const auto &decl : program->externalDecls) {
+        const AstNode *node = nullptr;
+        if (auto *funcDecl = llvm::dyn_cast<FuncDecl>(decl.get()); funcDecl && funcDecl->blockStmt) {
+            node = funcDecl;
+        }else if (auto *declStmt = llvm::dyn_cast<DeclStmt>(decl.get()); declStmt && !declStmt->nodeVec.empty()) {
+            node = declStmt->nodeVec.front().get();
+        }
+        if (node) {
+            diagEngine.Report(llvm::SMLoc::getFromPointer(node->tok.ptr), diag::err_pch_definition,
+                              llvm::StringRef(node->tok.ptr, node->tok.len));
+        }
+    }
+
+    /// 头文件自身也算被包含过，使用预编译头的源文件中的 #include 会被跳过
+    std::vector<std::string> includedFiles = preprocessor.GetIncludedFiles();
+    llvm::SmallString<256> realPath;
+    if (!llvm::sys::fs::real_path(input, realPath)) {
+        includedFiles.push_back(realPath.str().str());
+    }
+    return PCHWriter().Write(sema.GetScope(), preprocessor.GetMacroDefinitions(), includedFiles, GetPCHOptions(opts),
+                             output);
+}
+
+void Driver::PrintTimeReport(TimeReport &report) {
+    std::lock_guard<std::mutex> lock(outsMutex);
+    report.Print(llvm::errs(), opts.timeReportTopN);
+}
+
+void Driver::PrintMemReport(MemReport &report) {
+    std::lock_guard<std::mutex> lock(outsMutex);
+    report.Print(llvm::errs());
+}
+
+/// 与输出文件放在一起: out/foo.o -> out/foo.json, 输出到 stdout 或者 --run 时写到当前目录: foo.c -> foo.json
+/// 链接模式下目标文件是临时文件，写到源文件旁边: dir/foo.c -> dir/foo.json
+void Driver::WriteTimeTrace(llvm::StringRef input, llvm::StringRef output) {
+    if (!llvm::timeTraceProfilerEnabled()) {
+        return;
+    }
+    llvm::SmallString<128> path;
+    if (opts.timeTraceNextToInput && input != "-") {
+        path = input;
+    }else if (!output.empty() && output != "-") {
+        path = output;
+    }else {
+        path = input == "-" ? "stdin" : llvm::sys::path::filename(input);
+    }
+    llvm::sys::path::replace_extension(path, "json");
+    if (auto err = llvm::timeTraceProfilerWrite(path, "")) {
+        std::lock_guard<std::mutex> lock(outsMutex);
+        llvm::WithColor::error() << "can't write time trace '" << path << "': " << llvm::toString(std::move(err)) << "\n";
+    }
+    llvm::timeTraceProfilerCleanup();
+}
+
+void Driver::PrintThroughput(llvm::raw_ostream &os, double seconds) {
+    seconds = std::max(seconds, 1e-9);
+    os << "===-------------------------------------------------------------------------===\n";
+    os << "                              subc throughput\n";
+    os << "===-------------------------------------------------------------------------===\n";
+    os << llvm::format("  files      %12llu\n", (unsigned long long)numFiles);
+    os << llvm::format("  lines      %12llu\n", (unsigned long long)numLines);
+    os << llvm::format("  bytes      %12llu\n", (unsigned long long)numBytes);
+    os << llvm::format("  wall       %12.3f s\n", seconds);
+    os << llvm::format("  files/s    %12.1f\n", numFiles / seconds);
+    os << llvm::format("  lines/s    %12.1f\n", numLines / seconds);
+    os << llvm::format("  MB/s       %12.3f\n", numBytes / seconds / (1024.0 * 1024.0));
+}
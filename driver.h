@@ -0,0 +1,155 @@
+#pragma once
+#include "mem_report.h"
+#include "pch.h"
+#include "preprocessor.h"
+#include "time_report.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Passes/OptimizationLevel.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/PGOOptions.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/TargetParser/Triple.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// 编译选项，由 main.cc 中的命令行参数填充
+struct CompileOptions {
+    std::string triple;
+    /// 已经把 native 解析成具体的 cpu 和特性
+    std::string cpu{"generic"};
+    std::string features;
+    llvm::OptimizationLevel optLevel{llvm::OptimizationLevel::O0};
+    llvm::CodeGenOptLevel codeGenOptLevel{llvm::CodeGenOptLevel::None};
+    llvm::CodeGenFileType fileType{llvm::CodeGenFileType::AssemblyFile};
+    bool printIR{false};
+    /// 大于 1 时，用 SplitModule 把 module 拆分，并行做指令选择/寄存器分配
+    unsigned codegenPartitions{1};
+    /// 不为 1 时，大文件切成多段并行做词法分析 (0 表示全部核心)
+    unsigned lexThreads{1};
+    /// -I, 按顺序查找 #include 的头文件
+    std::vector<std::string> includeDirs;
+    /// -D, 每一项是 NAME 或 NAME=VALUE
+    std::vector<std::string> defines;
+    /// --include-pch, 为空时不使用预编译头
+    std::string includePCH;
+    /// -g
+    bool debugInfo{false};
+    /// IRInstr: 插入 InstrProf 计数器，程序退出时写出 profileFile(.profraw)
+    /// IRUse: 读取合并后的 profileFile(.profdata)，给分支加上权重、给函数加上入口计数
+    llvm::PGOOptions::PGOAction pgoAction{llvm::PGOOptions::NoAction};
+    std::string profileFile;
+    /// -ftime-report, 每个文件编译完后把各阶段耗时打印到 stderr
+    bool timeReport{false};
+    unsigned timeReportTopN{10};
+    /// -ftime-trace, 每个文件输出一个 chrome trace(<output>.json)，小于 granularity 微秒的事件会被丢弃
+    bool timeTrace{false};
+    unsigned timeTraceGranularity{500};
+    /// 链接模式下输出是临时文件，trace 写到源文件旁边而不是输出文件旁边
+    bool timeTraceNextToInput{false};
+    /// -fmem-report, 每个文件编译完后把各阶段的内存占用打印到 stderr
+    bool memReport{false};
+};
+
+/// -O 选项 (0, 1, 2, 3, s, z) -> optLevel 和 codeGenOptLevel, -Os/-Oz 的后端走 Default; 不认识的级别返回 false
+/// subc 和 subc-bench 共用，保证两者测的是同一套优化级别
+bool SetOptimizationLevel(CompileOptions &opts, char level);
+
+class CompileCache;
+
+/// 编译服务在 fork 之前创建好的 TargetMachine, key 是 (triple, cpu, features, CodeGenOptLevel)
+/// fork 出的子进程各自有一份拷贝，CreateTargetMachine 时取走配置相同的一个，不用再从头创建
+class TargetMachineCache {
+private:
+    std::mutex mutex;
+    llvm::StringMap<std::unique_ptr<llvm::TargetMachine>> machines;
+
+    static std::string GetKey(llvm::StringRef triple, llvm::StringRef cpu, llvm::StringRef features,
+                              llvm::CodeGenOptLevel level);
+public:
+    void Add(std::unique_ptr<llvm::TargetMachine> tm);
+    /// 没有配置相同的 TargetMachine 时返回 nullptr
+    std::unique_ptr<llvm::TargetMachine> Take(llvm::StringRef triple, llvm::StringRef cpu, llvm::StringRef features,
+                                              llvm::CodeGenOptLevel level);
+};
+
+/// 前端的产物，module 必须在 context 之前析构
+struct ModuleUnit {
+    std::unique_ptr<llvm::LLVMContext> context;
+    std::unique_ptr<llvm::Module> module;
+    /// 预处理之后的 token 个数
+    size_t numTokens{0};
+};
+
+/// source -> module -> 优化 -> 汇编/目标文件
+/// 每个源文件都有自己的 SourceMgr/Sema/CodeGen(LLVMContext) 和 TargetMachine，CompileFile 可以在多个线程中并发调用
+class Driver {
+private:
+    CompileOptions opts;
+    llvm::Triple triple;
+    const llvm::Target *target{nullptr};
+    /// 为空时不使用缓存
+    CompileCache *cache{nullptr};
+    /// 编译服务预先创建的 TargetMachine, 为空时总是新建
+    TargetMachineCache *machines{nullptr};
+    /// 多个源文件 (包括 CompileFiles 的多个线程) 共享，同一个头文件只扫描一次
+    HeaderCache headerCache;
+    /// --include-pch, 所有源文件共享同一份 mmap 进来的文件
+    std::unique_ptr<PCHFile> pch;
+
+    std::mutex outsMutex;
+    std::atomic<uint64_t> numFiles{0};
+    std::atomic<uint64_t> numBytes{0};
+    std::atomic<uint64_t> numLines{0};
+public:
+    Driver(const CompileOptions &opts, CompileCache *cache = nullptr, TargetMachineCache *machines = nullptr);
+
+    /// 查找 triple 对应的 target, 失败时打印错误
+    bool InitTarget();
+
+    const llvm::Triple &GetTriple() const {
+        return triple;
+    }
+
+    std::unique_ptr<llvm::TargetMachine> CreateTargetMachine();
+    /// 同上，并把 module 的 triple 和 DataLayout 设置成与 TargetMachine 一致
+    std::unique_ptr<llvm::TargetMachine> CreateTargetMachine(llvm::Module &module);
+
+    /// 打开 opts.includePCH, 失败时打印错误
+    bool LoadPCH();
+    /// 预处理并解析头文件 input, 把其中的声明和宏写成预编译头 output
+    bool EmitPCH(llvm::StringRef input, llvm::StringRef output);
+
+    /// 读取源文件("-" 表示 stdin)，并统计吞吐
+    std::unique_ptr<llvm::MemoryBuffer> ReadSource(llvm::StringRef input);
+    /// 编译缓存的 key, includedFiles 是预处理时包含过的头文件
+    std::string GetCacheKey(llvm::StringRef input, llvm::StringRef source, llvm::ArrayRef<std::string> includedFiles);
+
+    /// 预处理之后调用 afterPreprocess, 它返回 true 时 (例如命中编译缓存) 不再解析和生成代码，unit 保持为空
+    bool GenerateModule(std::unique_ptr<llvm::MemoryBuffer> buf, ModuleUnit &unit, TimeReport *timeReport = nullptr,
+                        MemReport *memReport = nullptr,
+                        llvm::function_ref<bool(const Preprocessor &)> afterPreprocess = nullptr);
+    void OptimizeModule(llvm::Module &module, llvm::TargetMachine *tm);
+    bool EmitFile(llvm::Module &module, llvm::TargetMachine *tm, llvm::StringRef output);
+    bool EmitFileParallel(llvm::Module &module, llvm::StringRef output);
+
+    bool CompileFile(llvm::StringRef input, llvm::StringRef output);
+    /// 使用线程池并发编译，threads 为 0 时使用全部核心
+    bool CompileFiles(llvm::ArrayRef<std::string> inputs, llvm::ArrayRef<std::string> outputs, unsigned threads);
+
+    /// 使用 ORC LLLazyJIT 执行 main, 返回 main 的返回值
+    int RunWithJIT(llvm::StringRef input);
+
+    void PrintTimeReport(TimeReport &report);
+    void PrintMemReport(MemReport &report);
+    void WriteTimeTrace(llvm::StringRef input, llvm::StringRef output = "");
+    void PrintThroughput(llvm::raw_ostream &os, double seconds);
+};
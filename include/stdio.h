@@ -0,0 +1,14 @@
+/* subc 自带的最小 stdio.h: 只声明常用的函数，实现来自链接的 libc */
+#ifndef SUBC_STDIO_H
+#define SUBC_STDIO_H
+
+#define EOF (-1)
+
+int printf(const char *format, ...);
+int scanf(const char *format, ...);
+int sprintf(char *str, const char *format, ...);
+int puts(const char *s);
+int putchar(int c);
+int getchar();
+
+#endif
@@ -0,0 +1,29 @@
+/* subc 自带的最小 stdlib.h */
+#ifndef SUBC_STDLIB_H
+#define SUBC_STDLIB_H
+
+#ifndef NULL
+#define NULL ((void *)0)
+#endif
+
+#ifndef SUBC_SIZE_T
+#define SUBC_SIZE_T
+typedef unsigned long int size_t;
+#endif
+
+#define EXIT_SUCCESS 0
+#define EXIT_FAILURE 1
+#define RAND_MAX 2147483647
+
+void *malloc(size_t size);
+void *calloc(size_t count, size_t size);
+void *realloc(void *ptr, size_t size);
+void free(void *ptr);
+void exit(int status);
+void abort();
+int abs(int x);
+int atoi(const char *s);
+int rand();
+void srand(unsigned int seed);
+
+#endif
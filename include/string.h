@@ -0,0 +1,26 @@
+/* subc 自带的最小 string.h */
+#ifndef SUBC_STRING_H
+#define SUBC_STRING_H
+
+#ifndef NULL
+#define NULL ((void *)0)
+#endif
+
+#ifndef SUBC_SIZE_T
+#define SUBC_SIZE_T
+typedef unsigned long int size_t;
+#endif
+
+void *memcpy(void *dst, const void *src, size_t n);
+void *memmove(void *dst, const void *src, size_t n);
+void *memset(void *dst, int c, size_t n);
+int memcmp(const void *a, const void *b, size_t n);
+size_t strlen(const char *s);
+int strcmp(const char *a, const char *b);
+int strncmp(const char *a, const char *b, size_t n);
+char *strcpy(char *dst, const char *src);
+char *strncpy(char *dst, const char *src, size_t n);
+char *strcat(char *dst, const char *src);
+char *strchr(const char *s, int c);
+
+#endif
@@ -1,6 +1,19 @@
 #include "lexer.h"
+#include "llvm/ADT/bit.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include <algorithm>
+#include <cassert>
+#include <charconv>
 #include <cstring>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 llvm::StringRef Token::GetSpellingText(TokenType tokenType) {
     switch (tokenType)
     {
@@ -130,6 +143,10 @@ llvm::StringRef Token::GetSpellingText(TokenType tokenType) {
         return "static";
     case TokenType::ellipse:
         return "...";
+    case TokenType::hash:
+        return "#";
+    case TokenType::hashhash:
+        return "##";
     case TokenType::kw_while:
         return "while";
     case TokenType::kw_do:
@@ -167,20 +184,174 @@ llvm::StringRef Token::GetSpellingText(TokenType tokenType) {
     }
 }
 
+namespace {
+enum CharClass : uint8_t {
+    kWhiteSpace = 1 << 0,
+    kDigit = 1 << 1,
+    kHexDigit = 1 << 2,
+    /// a-z A-Z _
+    kLetter = 1 << 3,
+    /// 数字常量中可以出现的字符: 0-9 a-z A-Z .
+    kNumberBody = 1 << 4,
+};
+
+/// 256 项的字符类别表，每个字符的判断都只是一次查表
+struct CharClassTable {
+    uint8_t classes[256]{};
+
+    constexpr CharClassTable() {
+        classes[(uint8_t)' '] = classes[(uint8_t)'\t'] = classes[(uint8_t)'\r'] = classes[(uint8_t)'\n'] = kWhiteSpace;
+        for (int ch = '0'; ch <= '9'; ++ch) {
+            classes[ch] = kDigit | kHexDigit;
+        }
+        for (int ch = 'a'; ch <= 'z'; ++ch) {
+            classes[ch] = kLetter;
+            classes[ch - 'a' + 'A'] = kLetter;
+        }
+        for (int ch = 'a'; ch <= 'f'; ++ch) {
+            classes[ch] |= kHexDigit;
+            classes[ch - 'a' + 'A'] |= kHexDigit;
+        }
+        classes[(uint8_t)'_'] = kLetter;
+        for (int ch = 0; ch < 256; ++ch) {
+            if (classes[ch] & (kDigit | kLetter)) {
+                classes[ch] |= kNumberBody;
+            }
+        }
+        classes[(uint8_t)'_'] &= ~kNumberBody;
+        classes[(uint8_t)'.'] = kNumberBody;
+    }
+
+    bool Is(char ch, uint8_t mask) const {
+        return classes[(uint8_t)ch] & mask;
+    }
+};
+}
+
+static constexpr CharClassTable charClasses;
+
 bool IsWhiteSpace(char ch) {
-    return ch == ' ' || ch == '\r' || ch == '\n' || ch == '\t';
+    return charClasses.Is(ch, kWhiteSpace);
 }
 
 bool IsDigit(char ch) {
-    return (ch >= '0' && ch <= '9');
+    return charClasses.Is(ch, kDigit);
 }
 
 bool IsHexDigit(char ch) {
-    return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'f') || (ch >= 'A' && ch <= 'F');
+    return charClasses.Is(ch, kHexDigit);
 }
 
 bool IsLetter(char ch) {
-    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch == '_');
+    return charClasses.Is(ch, kLetter);
+}
+
+/// 一次比较一个块(SSE2 16 字节, AVX2 32 字节)，Match 返回块内等于 c 的字节的位掩码
+/// 只在剩余字节足够一个完整的块时使用，剩下的尾部逐字节处理，不会读到缓冲区之外
+#if defined(__AVX2__)
+#define SUBC_LEXER_SIMD
+namespace {
+using Block = __m256i;
+constexpr int kBlockSize = 32;
+inline Block Load(const char *p) {
+    return _mm256_loadu_si256((const __m256i *)p);
+}
+inline uint32_t Match(Block block, char c) {
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(c)));
+}
+}
+#elif defined(__SSE2__)
+#define SUBC_LEXER_SIMD
+namespace {
+using Block = __m128i;
+constexpr int kBlockSize = 16;
+inline Block Load(const char *p) {
+    return _mm_loadu_si128((const __m128i *)p);
+}
+inline uint32_t Match(Block block, char c) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(c)));
+}
+}
+#endif
+
+#ifdef SUBC_LEXER_SIMD
+/// 低 n 位为 1 的掩码
+static inline uint32_t LowBits(unsigned n) {
+    return n >= 32 ? ~0u : (1u << n) - 1;
+}
+
+/// newlines 是一个块中换行符的位掩码
+static inline void CountNewLines(const char *blockStart, uint32_t newlines, int &row, const char *&lineHead) {
+    if (newlines) {
+        row += llvm::popcount(newlines);
+        lineHead = blockStart + llvm::Log2_32(newlines) + 1;
+    }
+}
+#endif
+
+/// 跳过空白，返回第一个非空白字符
+static const char *SkipBlanks(const char *p, const char *end, int &row, const char *&lineHead) {
+#ifdef SUBC_LEXER_SIMD
+    /// token 之间通常只有一两个空白字符，先逐字节判断，较长的空白(缩进、空行)再按块跳过
+    for (int i = 0; i < 4; ++i, ++p) {
+        if (p >= end || !IsWhiteSpace(*p)) {
+            return p;
+        }
+        if (*p == '\n') {
+            row++;
+            lineHead = p + 1;
+        }
+    }
+    while (end - p >= kBlockSize) {
+        Block block = Load(p);
+        uint32_t newlines = Match(block, '\n');
+        uint32_t blanks = newlines | Match(block, ' ') | Match(block, '\t') | Match(block, '\r');
+        uint32_t others = ~blanks & LowBits(kBlockSize);
+        unsigned n = others ? llvm::countr_zero(others) : kBlockSize;
+        CountNewLines(p, newlines & LowBits(n), row, lineHead);
+        p += n;
+        if (others) {
+            return p;
+        }
+    }
+#endif
+    while (p < end && IsWhiteSpace(*p)) {
+        if (*p == '\n') {
+            row++;
+            lineHead = p + 1;
+        }
+        p++;
+    }
+    return p;
+}
+
+/// p 指向 "/*" 之后，返回 "*/" 之后的位置，注释没有结束时返回 end
+static const char *SkipBlockComment(const char *p, const char *end, int &row, const char *&lineHead) {
+#ifdef SUBC_LEXER_SIMD
+    /// 需要多读一个字节判断 '*' 后面的 '/'
+    while (end - p > kBlockSize) {
+        Block block = Load(p);
+        uint32_t closes = Match(block, '*') & Match(Load(p + 1), '/');
+        uint32_t newlines = Match(block, '\n');
+        if (closes) {
+            unsigned n = llvm::countr_zero(closes);
+            CountNewLines(p, newlines & LowBits(n), row, lineHead);
+            return p + n + 2;
+        }
+        CountNewLines(p, newlines, row, lineHead);
+        p += kBlockSize;
+    }
+#endif
+    for (; p < end; ++p) {
+        if (p[0] == '*' && p + 1 < end && p[1] == '/') {
+            return p + 2;
+        }
+        if (*p == '\n') {
+            row++;
+            lineHead = p + 1;
+        }
+    }
+    return end;
 }
 
 // Read a single character in a char or string literal.
@@ -231,6 +402,76 @@ static const char *c_char(int *res, const char *p) {
     return p + 1;
 }
 
+/// 先按长度、再按首字母分派，每个标识符最多和 1~2 个关键字比较，不是关键字时返回 identifier
+static TokenType GetKeywordType(llvm::StringRef text) {
+    auto match = [text](llvm::StringRef keyword, TokenType type) {
+        return text == keyword ? type : TokenType::identifier;
+    };
+    switch (text.size()) {
+    case 2:
+        switch (text[0]) {
+        case 'i': return match("if", TokenType::kw_if);
+        case 'd': return match("do", TokenType::kw_do);
+        }
+        break;
+    case 3:
+        switch (text[0]) {
+        case 'i': return match("int", TokenType::kw_int);
+        case 'f': return match("for", TokenType::kw_for);
+        }
+        break;
+    case 4:
+        switch (text[0]) {
+        case 'e': return match("else", TokenType::kw_else);
+        case 'v': return match("void", TokenType::kw_void);
+        case 'c': return text[1] == 'h' ? match("char", TokenType::kw_char) : match("case", TokenType::kw_case);
+        case 'l': return match("long", TokenType::kw_long);
+        case 'a': return match("auto", TokenType::kw_auto);
+        }
+        break;
+    case 5:
+        switch (text[0]) {
+        case 'b': return match("break", TokenType::kw_break);
+        case 'u': return match("union", TokenType::kw_union);
+        case 'w': return match("while", TokenType::kw_while);
+        case 's': return match("short", TokenType::kw_short);
+        case 'f': return match("float", TokenType::kw_float);
+        case 'c': return match("const", TokenType::kw_const);
+        }
+        break;
+    case 6:
+        switch (text[0]) {
+        case 's':
+            switch (text[1]) {
+            case 'i': return text[2] == 'z' ? match("sizeof", TokenType::kw_sizeof) : match("signed", TokenType::kw_signed);
+            case 't': return text[2] == 'r' ? match("struct", TokenType::kw_struct) : match("static", TokenType::kw_static);
+            case 'w': return match("switch", TokenType::kw_switch);
+            }
+            break;
+        case 'r': return match("return", TokenType::kw_return);
+        case 'd': return match("double", TokenType::kw_double);
+        case 'e': return match("extern", TokenType::kw_extern);
+        case 'i': return match("inline", TokenType::kw_inline);
+        }
+        break;
+    case 7:
+        switch (text[0]) {
+        case 'd': return match("default", TokenType::kw_default);
+        case 't': return match("typedef", TokenType::kw_typedef);
+        }
+        break;
+    case 8:
+        switch (text[0]) {
+        case 'c': return match("continue", TokenType::kw_continue);
+        case 'v': return match("volatile", TokenType::kw_volatile);
+        case 'u': return match("unsigned", TokenType::kw_unsigned);
+        case 'r': return match("register", TokenType::kw_register);
+        }
+        break;
+    }
+    return TokenType::identifier;
+}
+
 bool Lexer::StartWith(const char *p) {
     return !strncmp(BufPtr, p, strlen(p));
 }
@@ -239,38 +480,40 @@ bool Lexer::StartWith(const char *source, const char *target) {
     return !strncmp(source, target, strlen(target));
 }
 
-void Lexer::NextToken(Token &tok) {
-    
-    /// 1. 过滤空格 
-    while (IsWhiteSpace(*BufPtr) || StartWith("//") || StartWith("/*")) {
-        if (StartWith("//")) {
-            while (*BufPtr != '\n' && (BufPtr < BufEnd)){
-                BufPtr++;
-            }
+void Lexer::SkipWhiteSpaceAndComments() {
+    for (;;) {
+        BufPtr = SkipBlanks(BufPtr, BufEnd, row, LineHeadPtr);
+        if (BufEnd - BufPtr < 2 || (BufPtr[0] != '/' && BufPtr[0] != '\\')) {
+            return;
         }
-
-        if (StartWith("/*")) {
-            while ((BufPtr[0] != '*' || BufPtr[1] != '/') && (BufPtr < BufEnd)) {
-                if (*BufPtr == '\n') {
-                    row++;
-                    LineHeadPtr = BufPtr+1;
-                }
-                BufPtr++;
+        if (BufPtr[0] == '\\') {
+            /// 续行符: 反斜杠紧跟换行时当作空白 (多行的宏定义)
+            const char *p = BufPtr + 1;
+            if (*p == '\r' && BufEnd - p > 1) {
+                ++p;
             }
-            BufPtr += 2;
-        }
-
-        if (BufPtr >= BufEnd) {
-            tok.tokenType = TokenType::eof;
+            if (*p != '\n') {
+                return;
+            }
+            BufPtr = p + 1;
+            ++row;
+            LineHeadPtr = BufPtr;
+        } else if (BufPtr[1] == '/') {
+            /// 换行符留给 SkipBlanks 计数, memchr 本身就是向量化的
+            const void *newline = memchr(BufPtr + 2, '\n', BufEnd - BufPtr - 2);
+            BufPtr = newline ? static_cast<const char *>(newline) : BufEnd;
+        } else if (BufPtr[1] == '*') {
+            BufPtr = SkipBlockComment(BufPtr + 2, BufEnd, row, LineHeadPtr);
+        } else {
             return;
         }
-
-        if (*BufPtr == '\n') {
-            row++;
-            LineHeadPtr = BufPtr+1;
-        }
-        BufPtr++;
     }
+}
+
+void Lexer::NextToken(Token &tok) {
+    
+    /// 1. 过滤空格和注释
+    SkipWhiteSpaceAndComments();
 
     /// 2. 判断是否到结尾
     if (BufPtr >= BufEnd) {
@@ -285,116 +528,34 @@ void Lexer::NextToken(Token &tok) {
 
     if (*BufPtr == '\'') {
         tok.tokenType = TokenType::number;
-        tok.ty = CType::IntType;
-        tok.ptr = BufPtr++;
-        BufPtr = c_char((int *)&tok.value.v, BufPtr);
-        if (*BufPtr != '\'')
-            diagEngine.Report(llvm::SMLoc::getFromPointer(BufPtr), diag::err_unclosed_character);
-        BufPtr += 1;
+        tok.ptr = StartPtr;
+        BufPtr = ScanCharLiteral(BufPtr);
         tok.len = BufPtr - StartPtr;
     }
     else if (*BufPtr == '"') {
-        BufPtr++; // skip "
         tok.tokenType = TokenType::str;
-        tok.ptr = BufPtr;
-        std::string value;
-        while (*BufPtr != '"') {
-            if (!*BufPtr) {
-                diagEngine.Report(llvm::SMLoc::getFromPointer(BufPtr), diag::err_unclosed_string);
-            }
-            int c;
-            BufPtr = c_char(&c, BufPtr);
-            value += c;
-        }
-        BufPtr++; // skip "
+        tok.ptr = BufPtr + 1; // skip "
+        BufPtr = ScanStringLiteral(BufPtr);
         tok.len = BufPtr - tok.ptr;
-        tok.strVal = value;
-        tok.ty = std::make_shared<CArrayType>(CType::CharType, tok.len);
     }
     else if (StartWith("0x") || StartWith("0X") || 
             StartWith("0b") || StartWith("0B")  ||
             IsDigit(*BufPtr) || (*BufPtr == '.' && IsDigit(BufPtr[1]))) {
         const char *p = BufPtr;
-        for (;;) {
-            if (p[0] && p[1] && strchr("eEpP", p[0]) && strchr("+-", p[1]))
-                p += 2;
-            else if (isalnum(*p) || *p == '.')
+        while (charClasses.Is(*p, kNumberBody)) {
+            /// 指数的符号
+            if ((*p == 'e' || *p == 'E' || *p == 'p' || *p == 'P') && (p[1] == '+' || p[1] == '-'))
                 p++;
-            else
-                break;
+            p++;
         }
         BufPtr = ConvertNumber(tok, StartPtr, p);
     } else if (IsLetter(*BufPtr)) {
-        while (IsLetter(*BufPtr) || IsDigit(*BufPtr)) {
+        while (charClasses.Is(*BufPtr, kLetter | kDigit)) {
             BufPtr++;
         }
-        tok.tokenType = TokenType::identifier;
         tok.ptr = StartPtr;
         tok.len = BufPtr - StartPtr;
-        llvm::StringRef text = llvm::StringRef(tok.ptr, tok.len);
-        if (text == "int") {
-            tok.tokenType = TokenType::kw_int;
-        }else if (text == "if") {
-            tok.tokenType = TokenType::kw_if;
-        }else if (text == "else") {
-            tok.tokenType = TokenType::kw_else;
-        }else if (text == "for") {
-            tok.tokenType = TokenType::kw_for;
-        }else if (text == "break") {
-            tok.tokenType = TokenType::kw_break;
-        }else if (text == "continue") {
-            tok.tokenType = TokenType::kw_continue;
-        }else if (text == "sizeof") {
-            tok.tokenType = TokenType::kw_sizeof;
-        }else if (text == "struct") {
-            tok.tokenType = TokenType::kw_struct;
-        }else if (text == "union") {
-            tok.tokenType = TokenType::kw_union;
-        }else if (text == "return") {
-            tok.tokenType = TokenType::kw_return;
-        }else if (text == "void") {
-            tok.tokenType = TokenType::kw_void;
-        }else if (text == "char") {
-            tok.tokenType = TokenType::kw_char;
-        }else if (text == "const") {
-            tok.tokenType = TokenType::kw_const;
-        }else if (text == "volatile") {
-            tok.tokenType = TokenType::kw_volatile;
-        }else if (text == "static") {
-            tok.tokenType = TokenType::kw_static;
-        }else if (text == "while") {
-            tok.tokenType = TokenType::kw_while;
-        }else if (text == "do") {
-            tok.tokenType = TokenType::kw_do;
-        }else if (text == "switch") {
-            tok.tokenType = TokenType::kw_switch;
-        }else if (text == "case") {
-            tok.tokenType = TokenType::kw_case;
-        }else if (text == "default") {
-            tok.tokenType = TokenType::kw_default;
-        }else if (text == "short") {
-            tok.tokenType = TokenType::kw_short;
-        }else if (text == "long") {
-            tok.tokenType = TokenType::kw_long;
-        }else if (text == "float") {
-            tok.tokenType = TokenType::kw_float;
-        }else if (text == "double") {
-            tok.tokenType = TokenType::kw_double;
-        }else if (text == "signed") {
-            tok.tokenType = TokenType::kw_signed;
-        }else if (text == "unsigned") {
-            tok.tokenType = TokenType::kw_unsigned;
-        }else if (text == "typedef") {
-            tok.tokenType = TokenType::kw_typedef;
-        }else if (text == "auto") {
-            tok.tokenType = TokenType::kw_auto;
-        }else if (text == "extern") {
-            tok.tokenType = TokenType::kw_extern;
-        }else if (text == "register") {
-            tok.tokenType = TokenType::kw_register;
-        }else if (text == "inline") {
-            tok.tokenType = TokenType::kw_inline;
-        }
+        tok.tokenType = GetKeywordType(llvm::StringRef(tok.ptr, tok.len));
     }
     else {
         switch (*BufPtr)
@@ -711,8 +872,22 @@ void Lexer::NextToken(Token &tok) {
             }
             break;
         }        
+        case '#': {
+            if (BufPtr[1] == '#') {
+                tok.tokenType = TokenType::hashhash;
+                BufPtr+=2;
+                tok.ptr = StartPtr;
+                tok.len = 2;
+            }else {
+                tok.tokenType = TokenType::hash;
+                BufPtr++;
+                tok.ptr = StartPtr;
+                tok.len = 1;
+            }
+            break;
+        }
         default:
-            diagEngine.Report(llvm::SMLoc::getFromPointer(BufPtr), diag::err_unknown_char, *BufPtr);
+            Report(BufPtr, diag::err_unknown_char, *BufPtr);
             break;
         }
     }
@@ -728,7 +903,7 @@ const char * Lexer::ConvertNumber(Token &tok, const char *start, const char *end
 
 std::pair<bool, const char *> Lexer::ConvertIntNumber(Token &tok, const char *start, const char *end) {
   // Read a binary, octal, decimal or hexadecimal number.
-  char *p = const_cast<char*>(start);
+  const char *p = start;
   int base = 10;
   if (!strncasecmp(p, "0x", 2) && isxdigit(p[2])) {
     p += 2;
@@ -740,7 +915,14 @@ std::pair<bool, const char *> Lexer::ConvertIntNumber(Token &tok, const char *st
     base = 8;
   }
 
-  int64_t val = strtoul(p, &p, base);
+  /// from_chars 不处理 locale 和前导空白; 溢出时与 strtoul 一样取最大值
+  uint64_t uval = 0;
+  auto [digitsEnd, ec] = std::from_chars(p, end, uval, base);
+  if (ec == std::errc::result_out_of_range) {
+    uval = UINT64_MAX;
+  }
+  p = digitsEnd;
+  int64_t val = uval;
 
   // Read U, L or LL suffixes.
   bool l = false;
@@ -798,17 +980,39 @@ std::pair<bool, const char *> Lexer::ConvertIntNumber(Token &tok, const char *st
   }
 
   tok.tokenType = TokenType::number;
-  tok.ty = ty;
   tok.ptr = start;
   tok.len = end - start;
-  tok.value.v = val;
+  literalPtr = start;
+  literal.ty = ty;
+  literal.value.v = val;
   return {true, end};
 }
 
+/// 解析 [p, end) 开头最长的浮点数，返回解析结束的位置
+/// from_chars 是正确舍入的 (libstdc++ 中是 Eisel-Lemire 算法)，不经过 long double，也不受 locale 影响;
+/// 溢出/下溢等少见的情况交给 strtod
+static const char *ParseFloat(const char *p, const char *end, double &val) {
+#if defined(__cpp_lib_to_chars)
+  const char *digits = p;
+  std::chars_format fmt = std::chars_format::general;
+  if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    digits += 2;
+    fmt = std::chars_format::hex;
+  }
+  auto [ptr, ec] = std::from_chars(digits, end, val, fmt);
+  if (ec == std::errc()) {
+    return ptr;
+  }
+#endif
+  char *parsed;
+  val = strtod(p, &parsed);
+  return parsed;
+}
+
 std::pair<bool, const char *> Lexer::ConvertFloatNumber(Token &tok, const char *pstart, const char *pend) {
   // If it's not an integer, it must be a floating point constant.
-  char *end;
-  long double val = strtold(pstart, &end);
+  double val;
+  const char *end = ParseFloat(pstart, pend, val);
 
   std::shared_ptr<CType> ty;
   if (*end == 'f' || *end == 'F') {
@@ -822,32 +1026,187 @@ std::pair<bool, const char *> Lexer::ConvertFloatNumber(Token &tok, const char *
   }
 
   if (pend != end) {
-    diagEngine.Report(llvm::SMLoc::getFromPointer(end), diag::err_numeric_constant);
+    Report(end, diag::err_numeric_constant);
     return {false, end};
   }
 
   tok.tokenType = TokenType::number;
-  tok.value.d = val;
-  tok.ty = ty;
   tok.ptr = pstart;
   tok.len = pend - pstart;
+  literalPtr = pstart;
+  literal.value.d = val;
+  literal.ty = ty;
   return {true, pend};
 }
 
-void Lexer::SaveState() {
-    State state;
-    state.BufPtr = BufPtr;
-    state.LineHeadPtr = LineHeadPtr;
-    state.BufEnd = BufEnd;
-    state.row = row;
-    stateStack.push(state);
+const char *Lexer::ScanCharLiteral(const char *p) {
+    literalPtr = p++;
+    literal.ty = CType::IntType;
+    int c;
+    p = c_char(&c, p);
+    literal.value.v = c;
+    if (*p != '\'')
+        Report(p, diag::err_unclosed_character);
+    return p + 1;
+}
+
+const char *Lexer::ScanStringLiteral(const char *p) {
+    const char *start = ++p; // skip "
+    literalPtr = start;
+    literal.strVal.clear();
+    while (*p != '"') {
+        if (!*p) {
+            Report(p, diag::err_unclosed_string);
+            return p;
+        }
+        int c;
+        p = c_char(&c, p);
+        literal.strVal += c;
+    }
+    p++; // skip "
+    literal.ty = std::make_shared<CArrayType>(CType::CharType, p - start);
+    return p;
+}
+
+const Literal &Lexer::GetLiteral(const Token &tok) {
+    if (tok.ptr != literalPtr) {
+        if (tok.tokenType == TokenType::str) {
+            ScanStringLiteral(tok.ptr - 1);
+        } else if (*tok.ptr == '\'') {
+            ScanCharLiteral(tok.ptr);
+        } else {
+            Token numTok;
+            ConvertNumber(numTok, tok.ptr, tok.ptr + tok.len);
+        }
+    }
+    assert(tok.ptr == literalPtr && "not a literal token");
+    return literal;
+}
+
+void Lexer::TokenizeUntil(std::vector<Token> &tokens, const char *end) {
+    Token tok;
+    for (;;) {
+        SkipWhiteSpaceAndComments();
+        if (BufPtr >= end) {
+            return;
+        }
+        NextToken(tok);
+        if (failed) {
+            return;
+        }
+        tokens.push_back(tok);
+    }
+}
+
+/// 从 p 开始找一个切分点: 优先选下一个不以空白、'*'、'/' 开头的行 (多半不在注释中)，
+/// 找不到时退化为下一行的行首。选错了也没关系，拼接时会校验
+static const char *FindSplitPoint(const char *p, const char *end) {
+    const char *fallback = nullptr;
+    for (int lines = 0; lines < 256 && p < end; ++lines) {
+        const void *newline = memchr(p, '\n', end - p);
+        if (!newline) {
+            break;
+        }
+        p = static_cast<const char *>(newline) + 1;
+        if (!fallback) {
+            fallback = p;
+        }
+        if (p < end && !IsWhiteSpace(*p) && *p != '*' && *p != '/') {
+            return p;
+        }
+    }
+    return fallback ? fallback : end;
 }
 
-void Lexer::RestoreState() {
-    State state = stateStack.top();
-    stateStack.pop();
-    BufPtr = state.BufPtr;
-    LineHeadPtr = state.LineHeadPtr;
-    BufEnd = state.BufEnd;
-    row = state.row;
+namespace {
+struct LexChunk {
+    const char *begin;
+    const char *end;
+    std::vector<Token> tokens;
+    /// 跳过 begin 处的空白和注释后，第一个 token 的位置
+    const char *first{nullptr};
+    int firstRow{1};
+    /// 扫描结束时的状态，row 是相对于 begin 的行号
+    const char *stop{nullptr};
+    const char *stopLineHead{nullptr};
+    int stopRow{1};
+    bool failed{false};
+};
+}
+
+void Lexer::TokenizeParallel(std::vector<Token> &tokens, unsigned numChunks) {
+    std::vector<LexChunk> chunks(numChunks);
+    size_t chunkSize = (BufEnd - BufPtr) / numChunks;
+    for (unsigned i = 0; i < numChunks; ++i) {
+        chunks[i].begin = i == 0 ? BufPtr : std::max(chunks[i - 1].begin, FindSplitPoint(BufPtr + i * chunkSize, BufEnd));
+        chunks[i].end = BufEnd;
+        if (i > 0) {
+            chunks[i - 1].end = chunks[i].begin;
+        }
+    }
+
+    {
+        llvm::DefaultThreadPool pool(llvm::hardware_concurrency(threads));
+        for (unsigned i = 0; i < numChunks; ++i) {
+            pool.async([this, &chunks, i]() {
+                LexChunk &chunk = chunks[i];
+                Lexer lexer(*this);
+                lexer.speculative = true;
+                lexer.BufPtr = chunk.begin;
+                if (i > 0) {
+                    lexer.LineHeadPtr = chunk.begin;
+                    lexer.row = 1;
+                }
+                lexer.SkipWhiteSpaceAndComments();
+                chunk.first = lexer.BufPtr;
+                chunk.firstRow = lexer.row;
+                chunk.tokens.reserve((chunk.end - chunk.begin) / 4 + 1);
+                lexer.TokenizeUntil(chunk.tokens, chunk.end);
+                chunk.stop = lexer.BufPtr;
+                chunk.stopLineHead = lexer.LineHeadPtr;
+                chunk.stopRow = lexer.row;
+                chunk.failed = lexer.failed;
+            });
+        }
+        pool.wait();
+    }
+
+    /// 按顺序拼接: 上一段停下的位置正好是这一段第一个 token 的位置时，两者从这里开始的扫描完全相同，
+    /// 只需要修正行号; 否则切分点落在了注释或字符串中 (或者有错误)，在当前线程从上一段停下的位置重新扫描这一段
+    size_t numTokens = 0;
+    for (const auto &chunk : chunks) {
+        numTokens += chunk.tokens.size();
+    }
+    tokens.reserve(tokens.size() + numTokens + 1);
+    for (unsigned i = 0; i < numChunks; ++i) {
+        LexChunk &chunk = chunks[i];
+        if (!chunk.failed && (i == 0 || chunk.first == BufPtr)) {
+            int rowOffset = i == 0 ? 0 : row - chunk.firstRow;
+            for (Token tok : chunk.tokens) {
+                tok.row += rowOffset;
+                tokens.push_back(tok);
+            }
+            BufPtr = chunk.stop;
+            LineHeadPtr = chunk.stopLineHead;
+            row = chunk.stopRow + rowOffset;
+        } else {
+            TokenizeUntil(tokens, chunk.end);
+        }
+    }
+}
+
+void Lexer::Tokenize(std::vector<Token> &tokens) {
+    size_t size = BufEnd - BufPtr;
+    unsigned numThreads = threads == 1 ? 1 : llvm::hardware_concurrency(threads).compute_thread_count();
+    unsigned numChunks = std::min<size_t>(numThreads, size / minChunkSize);
+    if (numChunks > 1) {
+        TokenizeParallel(tokens, numChunks);
+    } else {
+        /// 粗略按平均每个 token 4 个字符预留
+        tokens.reserve(tokens.size() + size / 4 + 1);
+        TokenizeUntil(tokens, BufEnd);
+    }
+    Token eof = tokens.empty() ? Token{} : tokens.back();
+    eof.tokenType = TokenType::eof;
+    tokens.push_back(eof);
 }
\ No newline at end of file
@@ -4,7 +4,8 @@
 #include "type.h"
 #include "diag_engine.h"
 #include <string>
-#include <stack>
+#include <vector>
+#include <type_traits>
 
 /// char stream -> Token
 
@@ -89,25 +90,31 @@ enum class TokenType : uint8_t{
     kw_case,        // case
     kw_default,     // default
     ellipse,        // ...
+    hash,           // # 只在预处理指令和宏定义中出现
+    hashhash,       // ##
     eof             // end
 };
 
-class Token {
-public:
-    TokenType tokenType;
-    int row, col;
-
+/// 数字、字符和字符串字面量的值与类型，由 lexer 保存，Token 本身只记录位置
+struct Literal {
     union {
         int64_t v;
         double d;
     }value; // for number
 
     std::string strVal; // for ""
-    
-    const char *ptr; // for debug && diag
-    int len;
 
     std::shared_ptr<CType> ty; // for built-in type
+};
+
+/// Token 在 parser/sema 中到处按值传递，保持为 24 字节的 POD，拷贝时不涉及引用计数和堆分配
+class Token {
+public:
+    TokenType tokenType;
+    int row{0}, col{0};
+    int len{0};
+
+    const char *ptr{nullptr}; // for debug && diag
 
     void Dump() {
         llvm::outs() << "{ " << llvm::StringRef(ptr, len) << ", row = " << row << ", col = " << col << "}\n";
@@ -116,14 +123,18 @@ public:
     static llvm::StringRef GetSpellingText(TokenType tokenType);
 };
 
+static_assert(std::is_trivially_copyable<Token>::value && sizeof(Token) <= 24, "Token must stay a small POD");
+
 class Lexer {
 private:
     llvm::SourceMgr &mgr;
     DiagEngine &diagEngine;
     llvm::StringRef fileName;
 public:
-    Lexer(llvm::SourceMgr &mgr, DiagEngine &diagEngine) : mgr(mgr), diagEngine(diagEngine) {
-        unsigned id = mgr.getMainFileID();
+    Lexer(llvm::SourceMgr &mgr, DiagEngine &diagEngine) : Lexer(mgr, diagEngine, mgr.getMainFileID()) {}
+
+    /// 扫描 mgr 中的任意一个 buffer (头文件、预处理器拼接出来的文本)
+    Lexer(llvm::SourceMgr &mgr, DiagEngine &diagEngine, unsigned id) : mgr(mgr), diagEngine(diagEngine) {
         llvm::StringRef buf = mgr.getMemoryBuffer(id)->getBuffer();
         BufPtr = buf.begin();
         LineHeadPtr = buf.begin();
@@ -134,34 +145,67 @@ public:
 
     void NextToken(Token &tok);
 
-    void SaveState();
-    void RestoreState();
+    /// 扫描剩下的整个 buffer，追加到 tokens 中，最后一个是 eof
+    void Tokenize(std::vector<Token> &tokens);
+
+    /// threads 不为 1 时 (0 表示全部核心)，Tokenize 把至少两倍 minChunkSize 大小的 buffer
+    /// 在行首切成多段，在线程池中并行扫描后拼接，结果与串行扫描完全相同
+    void SetParallel(unsigned threads, size_t minChunkSize = 1 << 20) {
+        this->threads = threads;
+        this->minChunkSize = minChunkSize;
+    }
+
+    /// tok 必须是 number 或 str，返回的引用在下一次 GetLiteral/NextToken 之前有效
+    const Literal &GetLiteral(const Token &tok);
 
     DiagEngine &GetDiagEngine() const {
         return diagEngine;
     }
 
+    llvm::SourceMgr &GetSourceMgr() const {
+        return mgr;
+    }
+
     llvm::StringRef GetFileName() {
         return fileName;
     }
 private:
+    /// 跳过空白和注释，同时维护 row/LineHeadPtr
+    void SkipWhiteSpaceAndComments();
     bool StartWith(const char *p);
     bool StartWith(const char *source, const char *target);
     const char *ConvertNumber(Token &tok, const char *start, const char *end);
     std::pair<bool, const char *> ConvertIntNumber(Token &tok, const char *start, const char *end);
     std::pair<bool, const char *> ConvertFloatNumber(Token &tok, const char *start, const char *end);
+    const char *ScanCharLiteral(const char *p);
+    const char *ScanStringLiteral(const char *p);
+
+    /// 扫描起始位置在 end 之前的 token，结束时 BufPtr 停在 end 之后第一个不是空白和注释的位置
+    void TokenizeUntil(std::vector<Token> &tokens, const char *end);
+    void TokenizeParallel(std::vector<Token> &tokens, unsigned numChunks);
+
+    /// 推测扫描时不报错，只标记失败，由串行扫描重新扫描这一段并报告
+    template <typename... Args>
+    void Report(const char *loc, unsigned diagId, Args... args) {
+        if (speculative) {
+            failed = true;
+            return;
+        }
+        diagEngine.Report(llvm::SMLoc::getFromPointer(loc), diagId, std::forward<Args>(args)...);
+    }
 private:
     const char *BufPtr;
     const char *LineHeadPtr;
     const char *BufEnd;
     int row;
 
-    struct State{
-        const char *BufPtr;
-        const char *LineHeadPtr;
-        const char *BufEnd;
-        int row;
-    };
+    /// 只保存最近扫描到的一个字面量，其它的由 GetLiteral 从 token 的源码文本重新计算
+    Literal literal;
+    const char *literalPtr{nullptr};
 
-    std::stack<State> stateStack;
+    unsigned threads{1};
+    size_t minChunkSize{1 << 20};
+    /// 并行扫描中的一段，起点可能在注释或字符串中间
+    bool speculative{false};
+    bool failed{false};
 };
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include "linker.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+
+#ifdef SUBC_ENABLE_LLD
+#include "lld/Common/Driver.h"
+LLD_HAS_DRIVER(elf)
+#endif
+
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#ifdef SUBC_ENABLE_LLD
+/// 动态链接器的路径，只支持常见的 glibc 平台
+static const char *GetDynamicLinker(const llvm::Triple &triple) {
+    switch (triple.getArch()) {
+    case llvm::Triple::x86_64:
+        return "/lib64/ld-linux-x86-64.so.2";
+    case llvm::Triple::aarch64:
+        return "/lib/ld-linux-aarch64.so.1";
+    case llvm::Triple::riscv64:
+        return "/lib/ld-linux-riscv64-lp64d.so.1";
+    default:
+        return nullptr;
+    }
+}
+
+static std::vector<std::string> GetLibDirs(const llvm::Triple &triple) {
+    std::string multiarch = (triple.getArchName() + "-linux-gnu").str();
+    return {"/usr/lib/" + multiarch, "/lib/" + multiarch, "/usr/lib64", "/lib64", "/usr/lib", "/lib"};
+}
+
+static std::string FindFile(llvm::ArrayRef<std::string> dirs, llvm::StringRef name) {
+    for (const auto &dir : dirs) {
+        llvm::SmallString<128> path(dir);
+        llvm::sys::path::append(path, name);
+        if (llvm::sys::fs::exists(path)) {
+            return std::string(path);
+        }
+    }
+    return "";
+}
+
+/// 查找 gcc 的 crtbegin.o 所在目录, 形如 /usr/lib/gcc/x86_64-linux-gnu/12
+static std::string FindGccLibDir(const llvm::Triple &triple) {
+    std::string best;
+    for (std::string vendor : {"-linux-gnu", "-redhat-linux", "-pc-linux-gnu"}) {
+        llvm::SmallString<128> root("/usr/lib/gcc/");
+        root += triple.getArchName();
+        root += vendor;
+        std::error_code ec;
+        for (llvm::sys::fs::directory_iterator it(root, ec), end; it != end && !ec; it.increment(ec)) {
+            llvm::SmallString<128> crt(it->path());
+            llvm::sys::path::append(crt, "crtbegin.o");
+            if (llvm::sys::fs::exists(crt) && it->path() > best) {
+                best = it->path();
+            }
+        }
+    }
+    return best;
+}
+
+/// lld 使用全局状态，不可重入: CompileFiles 的多个线程 (ld -r 合并分区) 必须串行调用
+/// 出错之后 lld 的状态不能再复用 (canRunAgain 为 false)，之后的链接直接报错
+static std::mutex lldMutex;
+static bool lldCanRunAgain = true;
+
+static bool RunLLD(llvm::ArrayRef<std::string> args) {
+    std::vector<const char *> argv;
+    for (const auto &arg : args) {
+        argv.push_back(arg.c_str());
+    }
+    std::lock_guard<std::mutex> lock(lldMutex);
+    if (!lldCanRunAgain) {
+        llvm::WithColor::error() << "lld cannot be run again after a previous failure\n";
+        return false;
+    }
+    lld::Result res = lld::lldMain(argv, llvm::outs(), llvm::errs(), {{lld::Gnu, &lld::elf::link}});
+    lldCanRunAgain = res.canRunAgain;
+    return res.retCode == 0;
+}
+
+static bool LinkWithLLD(const llvm::Triple &triple, llvm::ArrayRef<std::string> objects, llvm::StringRef output,
+                        llvm::ArrayRef<std::string> libs) {
+    std::vector<std::string> libDirs = GetLibDirs(triple);
+    std::string gccDir = FindGccLibDir(triple);
+    /// 找不到时直接报错，否则空路径会作为输入交给 lld
+    std::string crt[3];
+    const char *crtNames[3] = {"crt1.o", "crti.o", "crtn.o"};
+    for (int i = 0; i < 3; ++i) {
+        crt[i] = FindFile(libDirs, crtNames[i]);
+        if (crt[i].empty()) {
+            llvm::WithColor::error() << "unable to find startup object '" << crtNames[i] << "' for linking\n";
+            return false;
+        }
+    }
+
+    std::vector<std::string> args = {"ld.lld", "-o", output.str(), "--eh-frame-hdr",
+                                     "-dynamic-linker", GetDynamicLinker(triple)};
+    args.push_back(crt[0]);
+    args.push_back(crt[1]);
+    if (!gccDir.empty()) {
+        args.push_back(gccDir + "/crtbegin.o");
+        args.push_back("-L" + gccDir);
+    }
+    for (const auto &dir : libDirs) {
+        args.push_back("-L" + dir);
+    }
+    args.insert(args.end(), objects.begin(), objects.end());
+    args.insert(args.end(), libs.begin(), libs.end());
+    args.push_back("-lc");
+    if (!gccDir.empty()) {
+        args.insert(args.end(), {"-lgcc", "--as-needed", "-lgcc_s", "--no-as-needed"});
+        args.push_back(gccDir + "/crtend.o");
+    }
+    args.push_back(crt[2]);
+    return RunLLD(args);
+}
+#endif
+
+/// 没有 lld 时，交给系统的 cc 去链接
+static bool RunSystemDriver(llvm::ArrayRef<std::string> args) {
+    llvm::ErrorOr<std::string> cc = llvm::sys::findProgramByName("cc");
+    if (!cc) {
+        llvm::WithColor::error() << "unable to find 'cc' in PATH for linking\n";
+        return false;
+    }
+    std::vector<llvm::StringRef> argv = {*cc};
+    argv.insert(argv.end(), args.begin(), args.end());
+
+    std::string errMsg;
+    int ret = llvm::sys::ExecuteAndWait(*cc, argv, std::nullopt, {}, 0, 0, &errMsg);
+    if (ret != 0) {
+        llvm::WithColor::error() << "link failed: " << errMsg << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool LinkExecutable(const llvm::Triple &triple, llvm::ArrayRef<std::string> objects, llvm::StringRef output,
+                    llvm::ArrayRef<std::string> libs) {
+#ifdef SUBC_ENABLE_LLD
+    if (triple.isOSLinux() && GetDynamicLinker(triple)) {
+        return LinkWithLLD(triple, objects, output, libs);
+    }
+#endif
+    std::vector<std::string> args(objects.begin(), objects.end());
+    args.insert(args.end(), libs.begin(), libs.end());
+    args.push_back("-o");
+    args.push_back(output.str());
+    /// 目标文件使用 Reloc::Static 生成，不能链接成 PIE
+    if (triple.isOSBinFormatELF()) {
+        args.push_back("-no-pie");
+    }
+    return RunSystemDriver(args);
+}
+
+bool LinkRelocatable(const llvm::Triple &triple, llvm::ArrayRef<std::string> objects, llvm::StringRef output) {
+#ifdef SUBC_ENABLE_LLD
+    if (triple.isOSBinFormatELF()) {
+        std::vector<std::string> args = {"ld.lld", "-r", "-o", output.str()};
+        args.insert(args.end(), objects.begin(), objects.end());
+        return RunLLD(args);
+    }
+#endif
+    std::vector<std::string> args = {"-r", "-nostdlib", "-o", output.str()};
+    args.insert(args.end(), objects.begin(), objects.end());
+    return RunSystemDriver(args);
+}
+
+/// 新的布局: <libdir>/clang/<major>/lib/<triple>/libclang_rt.profile.a
+/// 旧的布局: <libdir>/clang/<major>/lib/linux/libclang_rt.profile-<arch>.a
+std::string FindProfileRuntime(const llvm::Triple &triple) {
+#ifdef SUBC_LLVM_LIBRARY_DIR
+    llvm::SmallString<128> base(SUBC_LLVM_LIBRARY_DIR);
+    llvm::sys::path::append(base, "clang", std::to_string(LLVM_VERSION_MAJOR), "lib");
+
+    llvm::SmallString<128> perTarget(base);
+    llvm::sys::path::append(perTarget, triple.str(), "libclang_rt.profile.a");
+    if (llvm::sys::fs::exists(perTarget)) {
+        return std::string(perTarget);
+    }
+
+    llvm::SmallString<128> perOS(base);
+    llvm::sys::path::append(perOS, "linux", ("libclang_rt.profile-" + triple.getArchName() + ".a").str());
+    if (llvm::sys::fs::exists(perOS)) {
+        return std::string(perOS);
+    }
+#endif
+    return "";
+}
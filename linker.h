@@ -0,0 +1,16 @@
+#pragma once
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/TargetParser/Triple.h"
+#include <string>
+
+/// 将目标文件链接为可执行文件，libs 是额外的静态库(比如 profile 运行时)
+/// 开启 SUBC_ENABLE_LLD 时，ELF 目标直接在进程内调用 lld，否则回退到系统的 cc 驱动
+bool LinkExecutable(const llvm::Triple &triple, llvm::ArrayRef<std::string> objects, llvm::StringRef output,
+                    llvm::ArrayRef<std::string> libs = {});
+
+/// 将多个目标文件合并为一个可重定位目标文件(ld -r)
+bool LinkRelocatable(const llvm::Triple &triple, llvm::ArrayRef<std::string> objects, llvm::StringRef output);
+
+/// 查找 compiler-rt 的 profile 运行时(libclang_rt.profile.a)，-fprofile-generate 生成的程序需要链接它，找不到时返回空
+std::string FindProfileRuntime(const llvm::Triple &triple);
@@ -1,153 +1,364 @@
-#include "codegen.h"
-#include "diag_engine.h"
-#include "lexer.h"
-#include "parser.h"
-#include "print_visitor.h"
-#include "sema.h"
+#include "compile_cache.h"
+#include "compile_server.h"
+#include "driver.h"
+#include "linker.h"
 
 #include "llvm/CodeGen/CommandFlags.h"
-#include "llvm/Support/ErrorOr.h"
-#include "llvm/Support/MemoryBuffer.h"
-
-#include "llvm/ExecutionEngine/ExecutionEngine.h"
-#include "llvm/ExecutionEngine/SectionMemoryManager.h"
-#include "llvm/IR/LegacyPassManager.h"
-#include "llvm/IR/Verifier.h"
-#include "llvm/MC/TargetRegistry.h"
 #include "llvm/Support/CodeGen.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/TargetSelect.h"
-#include "llvm/Support/ToolOutputFile.h"
-#include "llvm/Target/TargetMachine.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/TargetParser/Host.h"
+#include "llvm/TargetParser/SubtargetFeature.h"
 
-#include <llvm/TargetParser/Host.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
 
 using namespace llvm;
-static cl::opt<std::string>
-InputFilename(cl::Positional, cl::desc("<input c source code>"), cl::init("-"));
+static cl::list<std::string>
+InputFilenames(cl::Positional, cl::desc("<input c source code>..."));
 
 static cl::opt<std::string>
-OutputFilename("o", cl::desc("Output Asmber"), cl::value_desc("filename"));
+OutputFilename("o", cl::desc("Output filename"), cl::value_desc("filename"));
+
+static cl::opt<bool>
+EmitObject("c", cl::desc("Emit an object file instead of assembly"));
+
+static cl::opt<bool>
+LinkExe("link", cl::desc("Link into an executable (in-process through lld when available)"));
 
 static cl::opt<std::string>
 TargetTriple("mtriple", cl::desc("Override target triple for module"));
 
-/// #define JIT_TEST
-int main(int argc, char *argv[]) {
-  cl::ParseCommandLineOptions(argc, argv, "llvm system compiler\n");
+static cl::opt<std::string>
+MCPU("mcpu", cl::desc("Target a specific cpu type, 'native' for the host cpu (default = generic, native for --run)"),
+     cl::value_desc("cpu-name"));
 
-  /// 初始化后端
-  llvm::InitializeAllTargets();
-  llvm::InitializeAllTargetMCs();
-  llvm::InitializeAllAsmPrinters();
-  llvm::InitializeAllAsmParsers();
+static cl::list<std::string>
+MAttrs("mattr", cl::CommaSeparated, cl::desc("Target specific attributes, e.g. -mattr=+avx2,-bmi"),
+       cl::value_desc("a1,+a2,-a3,..."));
 
-#ifdef JIT_TEST
-  LLVMLinkInMCJIT();
-#endif
+static cl::opt<bool>
+RunJIT("run", cl::desc("Execute main() with the ORC lazy JIT instead of emitting a file"));
+
+static cl::opt<unsigned>
+Jobs("j", cl::desc("Number of files compiled in parallel (default = all cores)"), cl::init(0));
+
+static cl::opt<unsigned>
+CodegenPartitions("codegen-partitions",
+                  cl::desc("Split each module into N partitions and run the backend on them in parallel (object output only)"),
+                  cl::init(1));
+
+static cl::opt<unsigned>
+LexThreads("lex-threads",
+           cl::desc("Lex source files larger than 2MB on N threads (0 = all cores)"),
+           cl::init(1));
+
+static cl::list<std::string>
+IncludeDirs("I", cl::Prefix, cl::desc("Add a directory to the #include search path"), cl::value_desc("dir"));
+
+static cl::list<std::string>
+Defines("D", cl::Prefix, cl::desc("Predefine a macro, e.g. -DNDEBUG or -DSIZE=16"), cl::value_desc("macro[=value]"));
+
+static cl::opt<bool>
+EmitPCH("emit-pch", cl::desc("Precompile a header's macros, typedefs, struct/union and function prototypes"));
+
+static cl::opt<std::string>
+IncludePCH("include-pch", cl::desc("Load declarations from a precompiled header created by --emit-pch"),
+           cl::value_desc("file"));
+
+static cl::opt<bool>
+PrintThroughput("throughput", cl::desc("Print aggregate compile throughput to stderr"));
+
+static cl::opt<bool>
+PrintTimeReport("ftime-report", cl::desc("Print per-phase and per-function compile times to stderr"));
+
+static cl::opt<unsigned>
+TimeReportTopN("ftime-report-top", cl::desc("Number of functions listed by -ftime-report (default = 10)"),
+               cl::init(10));
+
+static cl::opt<bool>
+PrintMemReport("fmem-report", cl::desc("Print per-phase peak RSS, heap usage, AST/CType counts and LLVM module size "
+                                       "to stderr (use -j 1, RSS is process-wide)"));
+
+static cl::opt<bool>
+TimeTrace("ftime-trace", cl::desc("Write a chrome trace of the compilation next to the output (<output>.json)"));
+
+static cl::opt<unsigned>
+TimeTraceGranularity("ftime-trace-granularity",
+                     cl::desc("Minimum time in microseconds of an event recorded by -ftime-trace (default = 500)"),
+                     cl::init(500));
+
+static cl::opt<bool>
+UseCache("fcache", cl::desc("Reuse outputs of unchanged inputs from the compilation cache"));
+
+static cl::opt<std::string>
+CacheDir("fcache-dir", cl::desc("Compilation cache directory, implies -fcache (default = ~/.cache/subc)"),
+         cl::value_desc("dir"));
+
+static cl::opt<std::string>
+CachePolicy("fcache-policy",
+            cl::desc("Cache pruning policy, e.g. 'cache_size_bytes=1g:prune_after=24h:prune_interval=20m'"),
+            cl::value_desc("policy"));
+
+static cl::opt<bool>
+PrintCacheStats("fcache-stats", cl::desc("Print compilation cache hit/miss statistics to stderr"));
+
+static cl::opt<std::string>
+ServerSocket("server", cl::desc("Run as a compile server listening on the unix domain socket <path>"),
+             cl::value_desc("path"));
+
+static cl::opt<std::string>
+ConnectSocket("connect", cl::desc("Forward this compilation to the compile server listening on <path>"),
+              cl::value_desc("path"));
+
+static cl::opt<std::string>
+ProfileGenerate("fprofile-generate", cl::ValueOptional,
+                cl::desc("Instrument the program to write an execution profile to <dir>/default_%m.profraw"),
+                cl::value_desc("dir"));
+
+static cl::opt<std::string>
+ProfileUse("fprofile-use", cl::desc("Optimize with the merged execution profile (<dir>/default.profdata for a directory)"),
+           cl::value_desc("file"));
+
+static cl::opt<std::string>
+ProfileRuntime("fprofile-runtime", cl::desc("Path of libclang_rt.profile.a linked by -fprofile-generate -link"),
+               cl::value_desc("file"));
 
-  static llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buf = llvm::MemoryBuffer::getFile(InputFilename);
-  if (!Buf) {
-    llvm::errs() << "can't open file!!!\n";
+static cl::opt<bool>
+DebugInfo("g", cl::desc("Generate source-level debug information (line tables, functions and variables)"));
+
+static cl::opt<bool>
+PrintIR("print-ir", cl::desc("Print the llvm ir of each module before optimization"));
+
+static cl::opt<char>
+OptLevel("O", cl::desc("Optimization level. [-O0, -O1, -O2, -O3, -Os or -Oz] (default = '-O0')"),
+         cl::Prefix, cl::init('0'));
+
+/// -mcpu/-mattr -> cpu 和特性字符串，native 使用当前机器的 cpu 和它支持的全部特性
+static void GetTargetCPUAndFeatures(std::string &CPU, std::string &Features) {
+  CPU = MCPU;
+  if (CPU.empty())
+    CPU = RunJIT ? "native" : "generic";
+  SubtargetFeatures F;
+  if (CPU == "native") {
+    CPU = sys::getHostCPUName().str();
+    for (const auto &Feature : sys::getHostCPUFeatures())
+      F.AddFeature(Feature.getKey(), Feature.getValue());
+  }
+  for (const auto &Attr : MAttrs)
+    F.AddFeature(Attr);
+  Features = F.getString();
+}
+
+/// -fprofile-generate/-fprofile-use -> PGO 的动作和 profile 文件，与 clang 的规则一致
+static bool GetProfileOptions(PGOOptions::PGOAction &Action, std::string &File) {
+  if (ProfileGenerate.getNumOccurrences() && !ProfileUse.empty()) {
+    llvm::WithColor::error() << "-fprofile-generate and -fprofile-use are mutually exclusive\n";
+    return false;
+  }
+  if (ProfileGenerate.getNumOccurrences()) {
+    if (RunJIT) {
+      llvm::WithColor::error() << "-fprofile-generate is not supported with --run\n";
+      return false;
+    }
+    SmallString<128> Path(ProfileGenerate);
+    sys::path::append(Path, "default_%m.profraw");
+    Action = PGOOptions::IRInstr;
+    File = std::string(Path);
+  } else if (!ProfileUse.empty()) {
+    SmallString<128> Path(ProfileUse);
+    if (sys::fs::is_directory(Path))
+      sys::path::append(Path, "default.profdata");
+    Action = PGOOptions::IRUse;
+    File = std::string(Path);
+  }
+  return true;
+}
+
+/// 未指定 -o 时，按照输入文件名推导输出文件名
+static std::string GetOutputFilename(StringRef InputFilename) {
+  if (!OutputFilename.empty())
+    return OutputFilename;
+  if (LinkExe)
+    return "a.out";
+  if (InputFilename == "-")
+    return "-";
+  SmallString<128> Path(sys::path::filename(InputFilename));
+  sys::path::replace_extension(Path, EmitPCH ? "pch" : EmitObject ? "o" : "s");
+  return std::string(Path);
+}
+
+/// 编译服务预先创建的 TargetMachine，直接编译时为空
+static TargetMachineCache WarmMachines;
+
+/// 命令行参数解析之后的编译流程，compile server 的每个任务也会走这里
+static int Compile() {
+  CompileOptions Opts;
+  if (!SetOptimizationLevel(Opts, OptLevel)) {
+    llvm::WithColor::error() << "invalid optimization level -O" << OptLevel << "\n";
     return -1;
   }
 
-  llvm::SourceMgr Mgr;
-  DiagEngine DiagE(Mgr);
-
-  Mgr.AddNewSourceBuffer(std::move(*Buf), llvm::SMLoc());
-
-  Lexer Lex(Mgr, DiagE);
-  Sema SM(DiagE);
-  Parser P(Lex, SM);
-  auto Prog = P.ParseProgram();
-  // PrintVisitor visitor(program);
-  CodeGen CG(Prog);
-
-  auto &M = CG.GetModule();
-
-//   llvm::outs() << "1>>>  output ir\n";
-//   M->print(llvm::outs(), nullptr);
-  assert(!llvm::verifyModule(*M));
-
-#ifdef JIT_TEST
-  {
-    llvm::EngineBuilder builder(std::move(M));
-    std::string error;
-    auto ptr = std::make_unique<llvm::SectionMemoryManager>();
-    auto ref = ptr.get();
-    std::unique_ptr<llvm::ExecutionEngine> ee(
-        builder.setErrorStr(&error)
-                .setEngineKind(llvm::EngineKind::JIT)
-                .setOptLevel(llvm::CodeGenOptLevel::None)
-                .setSymbolResolver(std::move(ptr))
-                .create());
-    ref->finalizeMemory(&error);
-
-    void *addr = (void *)ee->getFunctionAddress("main");
-    int res = ((int (*)())addr)();
-    llvm::errs() << "result: " << res << "\n";
+  if (InputFilenames.empty())
+    InputFilenames.push_back("-");
+  if (InputFilenames.size() > 1 && !OutputFilename.empty() && !LinkExe) {
+    llvm::WithColor::error() << "cannot specify -o with multiple input files unless -link\n";
+    return -1;
   }
-#else
 
-  std::string CustomTriple;
-  // If we are supposed to override the target triple, do so now.
-  if (!TargetTriple.empty())
-    CustomTriple = (Triple::normalize(TargetTriple));
+  Opts.triple = TargetTriple;
+  GetTargetCPUAndFeatures(Opts.cpu, Opts.features);
+  if (!GetProfileOptions(Opts.pgoAction, Opts.profileFile))
+    return -1;
+  Opts.fileType = (EmitObject || LinkExe) ? CodeGenFileType::ObjectFile : CodeGenFileType::AssemblyFile;
+  Opts.printIR = PrintIR;
+  Opts.debugInfo = DebugInfo;
+  Opts.codegenPartitions = std::max(1u, (unsigned)CodegenPartitions);
+  Opts.lexThreads = LexThreads;
+  Opts.includeDirs.assign(IncludeDirs.begin(), IncludeDirs.end());
+#ifdef SUBC_INCLUDE_DIR
+  /// 自带的 stdio.h 等头文件最后查找
+  Opts.includeDirs.push_back(SUBC_INCLUDE_DIR);
+#endif
+  Opts.defines.assign(Defines.begin(), Defines.end());
+  Opts.includePCH = IncludePCH;
+  Opts.timeReport = PrintTimeReport;
+  Opts.timeReportTopN = TimeReportTopN;
+  Opts.timeTrace = TimeTrace;
+  Opts.timeTraceGranularity = TimeTraceGranularity;
+  Opts.timeTraceNextToInput = LinkExe;
+  Opts.memReport = PrintMemReport;
 
-  Triple T(CustomTriple);
-  if (T.getTriple().empty()) {
-    T.setTriple(sys::getDefaultTargetTriple());
+  /// 编译缓存
+  std::unique_ptr<CompileCache> Cache;
+  if (UseCache || !CacheDir.empty()) {
+    SmallString<128> Dir(CacheDir);
+    if (Dir.empty()) {
+      if (!sys::path::cache_directory(Dir)) {
+        llvm::WithColor::error() << "unable to determine the cache directory, use -fcache-dir\n";
+        return -1;
+      }
+      sys::path::append(Dir, "subc");
+    }
+    Expected<CachePruningPolicy> Policy = parseCachePruningPolicy(CachePolicy);
+    if (!Policy) {
+      llvm::WithColor::error() << "invalid -fcache-policy: " << toString(Policy.takeError()) << "\n";
+      return -1;
+    }
+    Cache = std::make_unique<CompileCache>(Dir, *Policy);
+    if (!Cache->Init())
+      return -1;
   }
-  /// 1. 初始化一个triple
-  // llvm::Triple T;
-  // T.setArch(llvm::Triple::ArchType::aarch64);
-  // T.setOS(llvm::Triple::OSType::Darwin);
-  // T.setEnvironment(llvm::Triple::GNU);
-//   llvm::outs() << "\nthe triple: " << T.normalize() << "\n\n";
-  /// 2. 查找一个target
-  std::string Err;
-  const llvm::Target *TG = llvm::TargetRegistry::lookupTarget(T.normalize(), Err);
-  if (!TG) {
-    llvm::WithColor::error() << "target lookup failed with error: " << Err << "\n";
-    return 0;
+
+  Driver D(Opts, Cache.get(), &WarmMachines);
+
+  if (EmitPCH) {
+    if (InputFilenames.size() > 1 || InputFilenames[0] == "-") {
+      llvm::WithColor::error() << "--emit-pch expects a single header file\n";
+      return -1;
+    }
+    return D.EmitPCH(InputFilenames[0], GetOutputFilename(InputFilenames[0])) ? 0 : -1;
   }
+  if (!IncludePCH.empty() && !D.LoadPCH())
+    return -1;
 
-  /// 3. 创建target machine
-  auto Machine = std::unique_ptr<llvm::TargetMachine>(
-    TG->createTargetMachine(T.normalize(), "generic", "", {}, llvm::Reloc::Model::Static, {}, llvm::CodeGenOptLevel::None));
-
-  M->setTargetTriple(T.normalize());
-  M->setDataLayout(Machine->createDataLayout());
-
-  /// 4. 对比上面，此时输出会有 data layout信息
-  llvm::outs() << "2>>>  add data layout and triple, output ir\n";
-  M->print(llvm::outs(), nullptr);
-  assert(!llvm::verifyModule(*M));
-
-  /// 4. 创建输出
-  std::error_code EC;
-  llvm::raw_fd_ostream OS(OutputFilename, EC, llvm::sys::fs::OpenFlags::OF_None);
-  if (EC)
-  {
-    llvm::WithColor::error()
-      << "Can not open file \n";
-    return {};
+  if (RunJIT) {
+    if (InputFilenames.size() > 1) {
+      llvm::WithColor::error() << "--run expects a single input file\n";
+      return -1;
+    }
+    return D.RunWithJIT(InputFilenames[0]);
   }
 
-  /// 5. 通过target machine 来串联 输入(module)和输出(汇编文件)
-  llvm::legacy::PassManager PM;
-  if (Machine->addPassesToEmitFile(PM, OS, nullptr,
-                              CodeGenFileType::AssemblyFile)) {
-    llvm::WithColor::error()
-        << "No support for file type\n";
+  if (!D.InitTarget())
     return -1;
+
+  /// 链接模式下目标文件先写到临时文件
+  std::vector<std::string> Outputs;
+  for (const auto &Input : InputFilenames) {
+    if (LinkExe) {
+      SmallString<128> TmpPath;
+      if (sys::fs::createTemporaryFile("subc", "o", TmpPath)) {
+        llvm::WithColor::error() << "Can not create temporary file\n";
+        return -1;
+      }
+      Outputs.push_back(std::string(TmpPath));
+    } else {
+      Outputs.push_back(GetOutputFilename(Input));
+    }
   }
 
-  /// 6. 执行
-  PM.run(*M);
+  auto Start = std::chrono::steady_clock::now();
+  bool Ok = D.CompileFiles(InputFilenames, Outputs, Jobs);
+  std::chrono::duration<double> Elapsed = std::chrono::steady_clock::now() - Start;
 
-#endif
-    return 0;
+  /// 链接成可执行文件
+  if (LinkExe) {
+    /// 插桩后的程序依赖 compiler-rt 的 profile 运行时来写出 .profraw
+    std::vector<std::string> Libs;
+    if (Ok && Opts.pgoAction == PGOOptions::IRInstr) {
+      std::string Runtime = ProfileRuntime.empty() ? FindProfileRuntime(D.GetTriple()) : ProfileRuntime;
+      if (Runtime.empty()) {
+        llvm::WithColor::error() << "unable to find libclang_rt.profile.a, use -fprofile-runtime\n";
+        Ok = false;
+      }
+      Libs.push_back(Runtime);
+    }
+    if (Ok)
+      Ok = LinkExecutable(D.GetTriple(), Outputs, GetOutputFilename(""), Libs);
+    for (const auto &Obj : Outputs)
+      sys::fs::remove(Obj);
+  }
+
+  if (PrintThroughput)
+    D.PrintThroughput(llvm::errs(), Elapsed.count());
+
+  if (Cache) {
+    Cache->Prune();
+    if (PrintCacheStats)
+      Cache->PrintStats(llvm::errs());
+  }
+
+  return Ok ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+  cl::ParseCommandLineOptions(argc, argv, "llvm system compiler\n");
+
+  /// 客户端不需要初始化后端
+  if (!ConnectSocket.empty())
+    return RunCompileClient(ConnectSocket, argc, argv);
+
+  /// 初始化后端，编译服务 fork 出的子进程直接继承初始化好的 target
+  llvm::InitializeAllTargets();
+  llvm::InitializeAllTargetMCs();
+  llvm::InitializeAllAsmPrinters();
+  llvm::InitializeAllAsmParsers();
+
+  if (ServerSocket.empty())
+    return Compile();
+
+  /// 按服务启动时的 -target/-mcpu/-mattr 为每个后端优化级别预先创建 TargetMachine,
+  /// 使用同样配置的任务在子进程中直接取走，不再从头创建
+  CompileOptions WarmOpts;
+  WarmOpts.triple = TargetTriple;
+  GetTargetCPUAndFeatures(WarmOpts.cpu, WarmOpts.features);
+  for (CodeGenOptLevel Level : {CodeGenOptLevel::None, CodeGenOptLevel::Less, CodeGenOptLevel::Default,
+                                CodeGenOptLevel::Aggressive}) {
+    WarmOpts.codeGenOptLevel = Level;
+    Driver Warm(WarmOpts);
+    if (!Warm.InitTarget())
+      return -1;
+    WarmMachines.Add(Warm.CreateTargetMachine());
+  }
+
+  return RunCompileServer(ServerSocket, [](int Argc, const char *const *Argv) {
+    cl::ResetAllOptionOccurrences();
+    cl::ParseCommandLineOptions(Argc, Argv, "llvm system compiler\n");
+    return Compile();
+  });
 }
@@ -0,0 +1,166 @@
+#include "mem_report.h"
+#include "mem_usage.h"
+#include "llvm/Support/FormatVariadic.h"
+#include <algorithm>
+
+namespace {
+struct KindInfo {
+    const char *name;
+    size_t size;
+};
+}
+
+/// 与 AstNode::Kind 的顺序一致
+static const KindInfo astKinds[] = {
+    {"BlockStmt", sizeof(BlockStmt)},
+    {"DeclStmt", sizeof(DeclStmt)},
+    {"ForStmt", sizeof(ForStmt)},
+    {"BreakStmt", sizeof(BreakStmt)},
+    {"ContinueStmt", sizeof(ContinueStmt)},
+    {"IfStmt", sizeof(IfStmt)},
+    {"ReturnStmt", sizeof(ReturnStmt)},
+    {"SwitchStmt", sizeof(SwitchStmt)},
+    {"CaseStmt", sizeof(CaseStmt)},
+    {"DefaultStmt", sizeof(DefaultStmt)},
+    {"DoWhileStmt", sizeof(DoWhileStmt)},
+    {"VariableDecl", sizeof(VariableDecl)},
+    {"FuncDecl", sizeof(FuncDecl)},
+    {"BinaryExpr", sizeof(BinaryExpr)},
+    {"ThreeExpr", sizeof(ThreeExpr)},
+    {"UnaryExpr", sizeof(UnaryExpr)},
+    {"CastExpr", sizeof(CastExpr)},
+    {"SizeOfExpr", sizeof(SizeOfExpr)},
+    {"PostIncExpr", sizeof(PostIncExpr)},
+    {"PostDecExpr", sizeof(PostDecExpr)},
+    {"PostSubscript", sizeof(PostSubscript)},
+    {"PostMemberDotExpr", sizeof(PostMemberDotExpr)},
+    {"PostMemberArrowExpr", sizeof(PostMemberArrowExpr)},
+    {"PostFuncCall", sizeof(PostFuncCall)},
+    {"NumberExpr", sizeof(NumberExpr)},
+    {"VariableAccessExpr", sizeof(VariableAccessExpr)},
+    {"StringExpr", sizeof(StringExpr)},
+};
+static_assert(std::size(astKinds) == AstNode::ND_StringExpr + 1, "astKinds is out of sync with AstNode::Kind");
+
+static const KindInfo &GetTypeKind(int kind) {
+    static const KindInfo primary{"CPrimaryType", sizeof(CPrimaryType)};
+    static const KindInfo point{"CPointType", sizeof(CPointType)};
+    static const KindInfo array{"CArrayType", sizeof(CArrayType)};
+    static const KindInfo record{"CRecordType", sizeof(CRecordType)};
+    static const KindInfo func{"CFuncType", sizeof(CFuncType)};
+    switch (kind) {
+    case CType::TY_Point: return point;
+    case CType::TY_Array: return array;
+    case CType::TY_Record: return record;
+    case CType::TY_Func: return func;
+    default: return primary;
+    }
+}
+
+/// 节点都是 make_shared 创建的，引用计数和对象分配在一起
+static constexpr size_t kSharedControlBlock = 2 * sizeof(long);
+
+static std::string FormatBytes(int64_t bytes) {
+    double value = std::abs((double)bytes);
+    const char *unit = "B";
+    if (value >= (1 << 20)) {
+        value /= (1 << 20);
+        unit = "MiB";
+    } else if (value >= (1 << 10)) {
+        value /= (1 << 10);
+        unit = "KiB";
+    }
+    return llvm::formatv("{0}{1:f1} {2}", bytes < 0 ? "-" : "", value, unit).str();
+}
+
+MemReport::MemReport(llvm::StringRef fileName)
+    : fileName(fileName), startRSS(GetCurrentRSS()), startHeap(GetHeapInUse()), peakResettable(ResetPeakRSS()) {
+    AstNode::AllocCounts() = astCounts;
+    CType::AllocCounts() = typeCounts;
+}
+
+MemReport::~MemReport() {
+    /// 命中编译缓存时不会调用 RecordFrontend
+    if (AstNode::AllocCounts() == astCounts) {
+        AstNode::AllocCounts() = nullptr;
+        CType::AllocCounts() = nullptr;
+    }
+}
+
+void MemReport::EndPhase(Phase phase) {
+    PhaseStats &stats = phases[phase];
+    stats.recorded = true;
+    stats.peakRSS = GetPeakRSS();
+    stats.rss = GetCurrentRSS();
+    stats.heap = GetHeapInUse();
+    ResetPeakRSS();
+}
+
+void MemReport::RecordFrontend(const Sema &sema) {
+    AstNode::AllocCounts() = nullptr;
+    CType::AllocCounts() = nullptr;
+    numSymbols = sema.GetScope().GetNumSymbols();
+    symbolBytes = sema.GetScope().GetMemorySize();
+}
+
+void MemReport::RecordModule(const llvm::Module &module) {
+    numFunctions = module.size();
+    numGlobals = module.global_size();
+    numInstructions = module.getInstructionCount();
+}
+
+void MemReport::Print(llvm::raw_ostream &os) {
+    os << "===" << std::string(73, '-') << "===\n";
+    std::string title = "subc memory report: " + fileName;
+    os.indent((80 - std::min<size_t>(title.size(), 80)) / 2) << title << "\n";
+    os << "===" << std::string(73, '-') << "===\n";
+
+    const char *phaseNames[] = {"parse", "codegen", "opt", "backend"};
+    os << llvm::formatv("  {0,-10} {1,12} {2,12} {3,12} {4,12}\n", "Phase", "Peak RSS", "RSS", "Heap", "Heap delta");
+    os << llvm::formatv("  {0,-10} {1,12} {2,12} {3,12}\n", "start", "", FormatBytes(startRSS), FormatBytes(startHeap));
+    uint64_t prevHeap = startHeap;
+    for (int phase = kParse; phase < kNumPhases; ++phase) {
+        const PhaseStats &stats = phases[phase];
+        if (!stats.recorded) {
+            continue;
+        }
+        os << llvm::formatv("  {0,-10} {1,12} {2,12} {3,12} {4,12}\n", phaseNames[phase], FormatBytes(stats.peakRSS),
+                            FormatBytes(stats.rss), FormatBytes(stats.heap),
+                            FormatBytes((int64_t)stats.heap - (int64_t)prevHeap));
+        prevHeap = stats.heap;
+    }
+    if (!peakResettable) {
+        os << "  (peak RSS can't be reset on this system, it is the peak since process start)\n";
+    }
+
+    uint64_t numNodes = 0, nodeBytes = 0;
+    for (size_t i = 0; i < std::size(astCounts); ++i) {
+        numNodes += astCounts[i];
+        nodeBytes += astCounts[i] * (astKinds[i].size + kSharedControlBlock);
+    }
+    os << "\n  AST nodes: " << numNodes << " (~" << FormatBytes(nodeBytes) << ", Token copies "
+       << FormatBytes(numNodes * sizeof(Token)) << ")\n";
+    for (size_t i = 0; i < std::size(astCounts); ++i) {
+        if (astCounts[i]) {
+            os << llvm::formatv("    {0,-22} {1,10} {2,12}\n", astKinds[i].name, astCounts[i],
+                                FormatBytes(astCounts[i] * (astKinds[i].size + kSharedControlBlock)));
+        }
+    }
+
+    uint64_t numTypes = 0, typeBytes = 0;
+    for (size_t i = 0; i < std::size(typeCounts); ++i) {
+        numTypes += typeCounts[i];
+        typeBytes += typeCounts[i] * (GetTypeKind(i).size + kSharedControlBlock);
+    }
+    os << "  CType objects: " << numTypes << " (~" << FormatBytes(typeBytes) << ")\n";
+    os << "  Symbols (global scope): " << numSymbols << " (~" << FormatBytes(symbolBytes) << ")\n";
+
+    /// LLVMContext 没有内存统计接口，用 codegen 阶段 malloc 的增量近似 context + module 的大小
+    os << "  LLVM module: " << numFunctions << " functions, " << numGlobals << " globals, " << numInstructions
+       << " instructions";
+    if (phases[kCodeGen].recorded && phases[kParse].recorded) {
+        os << ", LLVMContext + Module ~"
+           << FormatBytes((int64_t)phases[kCodeGen].heap - (int64_t)phases[kParse].heap);
+    }
+    os << "\n\n";
+}
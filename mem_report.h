@@ -0,0 +1,56 @@
+#pragma once
+#include "ast.h"
+#include "sema.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+
+/// -fmem-report: 一个编译单元在各个阶段的内存占用
+/// 每个阶段结束时记录阶段内的峰值 RSS、RSS 和 malloc 的使用量；RSS 是进程级的，-j 并发编译时各文件会互相影响
+/// AST 节点和 CType 的个数来自构造函数中的计数(只在有 MemReport 的线程中计数)，字节数按 sizeof 估算
+class MemReport {
+public:
+    enum Phase {
+        kParse,
+        kCodeGen,
+        kOpt,
+        kBackend,
+        kNumPhases
+    };
+private:
+    struct PhaseStats {
+        bool recorded{false};
+        uint64_t peakRSS{0};
+        uint64_t rss{0};
+        uint64_t heap{0};
+    };
+    std::string fileName;
+    uint64_t startRSS;
+    uint64_t startHeap;
+    /// 不能分段重置峰值时，peak RSS 是从进程启动开始的
+    bool peakResettable;
+    PhaseStats phases[kNumPhases];
+
+    /// 从构造到 RecordFrontend 之间，当前线程创建的节点和类型计入这里
+    uint64_t astCounts[AstNode::ND_StringExpr + 1]{};
+    uint64_t typeCounts[CType::TY_Func + 1]{};
+    size_t numSymbols{0};
+    size_t symbolBytes{0};
+
+    size_t numFunctions{0};
+    size_t numGlobals{0};
+    size_t numInstructions{0};
+public:
+    MemReport(llvm::StringRef fileName);
+    ~MemReport();
+
+    /// 结束一个阶段，并为下一个阶段重新开始统计峰值
+    void EndPhase(Phase phase);
+    /// parse 结束后调用: 统计这个编译单元创建的 AST 节点、CType 以及全局作用域的符号表
+    void RecordFrontend(const Sema &sema);
+    /// codegen 结束后调用
+    void RecordModule(const llvm::Module &module);
+
+    void Print(llvm::raw_ostream &os);
+};
@@ -0,0 +1,76 @@
+#include "mem_usage.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define SUBC_HAVE_MALLINFO2
+#endif
+
+#include <fstream>
+
+/// 读取 /proc/self/status 中形如 "VmHWM:    1234 kB" 的一行
+static uint64_t ReadProcStatus(llvm::StringRef key) {
+    auto buf = llvm::MemoryBuffer::getFileAsStream("/proc/self/status");
+    if (!buf) {
+        return 0;
+    }
+    llvm::StringRef content = (*buf)->getBuffer();
+    while (!content.empty()) {
+        llvm::StringRef line;
+        std::tie(line, content) = content.split('\n');
+        if (!line.consume_front(key) || !line.consume_front(":")) {
+            continue;
+        }
+        uint64_t kb = 0;
+        line.trim().consumeInteger(10, kb);
+        return kb * 1024;
+    }
+    return 0;
+}
+
+uint64_t GetCurrentRSS() {
+    return ReadProcStatus("VmRSS");
+}
+
+uint64_t GetPeakRSS() {
+    if (uint64_t peak = ReadProcStatus("VmHWM")) {
+        return peak;
+    }
+#ifndef _WIN32
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return usage.ru_maxrss;
+#else
+        return usage.ru_maxrss * 1024;
+#endif
+    }
+#endif
+    return 0;
+}
+
+bool ResetPeakRSS() {
+    {
+        std::ofstream clearRefs("/proc/self/clear_refs");
+        if (!clearRefs) {
+            return false;
+        }
+        clearRefs << "5";
+    }
+    /// 有的内核(或沙箱)接受写入但不会重置，重置后峰值应当接近当前值
+    return GetPeakRSS() <= GetCurrentRSS() + (1 << 20);
+}
+
+uint64_t GetHeapInUse() {
+#ifdef SUBC_HAVE_MALLINFO2
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+
+/// 当前进程的内存占用，单位是字节
+/// Linux 上读取 /proc/self/status 的 VmRSS/VmHWM，其他平台 peak 回退到 getrusage，current 返回 0
+uint64_t GetCurrentRSS();
+uint64_t GetPeakRSS();
+
+/// 把 peak RSS 重置为当前 RSS(Linux 4.0+ 的 /proc/self/clear_refs)，以便分段统计峰值，不支持时返回 false
+bool ResetPeakRSS();
+
+/// malloc 当前分配出去的字节数(glibc 2.33+ 的 mallinfo2，包含 mmap 分配的大块)，不支持时返回 0
+uint64_t GetHeapInUse();
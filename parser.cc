@@ -1,17 +1,27 @@
 #include "parser.h"
 #include "eval_constant.h"
+#include "llvm/Support/TimeProfiler.h"
+#include <algorithm>
+
+Parser::Parser(Lexer &lexer, Sema &sema, TimeReport *timeReport) : lexer(lexer), sema(sema), timeReport(timeReport) {
+    {
+        llvm::TimeRegion region(timeReport ? &timeReport->lexTimer : nullptr);
+        lexer.Tokenize(tokens);
+    }
+    tok = tokens[pos];
+}
+
+Parser::Parser(Lexer &lexer, Sema &sema, std::vector<Token> tokens, TimeReport *timeReport)
+    : lexer(lexer), sema(sema), timeReport(timeReport), tokens(std::move(tokens)) {
+    tok = this->tokens[pos];
+}
 
 std::shared_ptr<Program> Parser::ParseProgram() {
 
     auto program = std::make_shared<Program>();
     program->fileName = lexer.GetFileName();
     while (tok.tokenType != TokenType::eof) {
-        std::shared_ptr<AstNode> node;
-        if (IsFuncDecl()) {
-            node = ParseFuncDecl();
-        }else {
-            node = ParseDeclStmt(true);
-        }
+        auto node = ParseExternalDecl();
         if (node) {
             program->externalDecls.push_back(node);
         }
@@ -20,13 +30,35 @@ std::shared_ptr<Program> Parser::ParseProgram() {
     return program;
 }
 
-std::shared_ptr<AstNode> Parser::ParseFuncDecl() {
-    bool isTypedef = false;
-    auto baseType = ParseDeclSpec(isTypedef);
+/// 声明符只解析一次，解析完之后才知道是函数还是变量/typedef
+std::shared_ptr<AstNode> Parser::ParseExternalDecl() {
+    llvm::TimeRecord startTime;
+    if (timeReport) {
+        startTime = llvm::TimeRecord::getCurrentTime(true);
+    }
+    bool isTypedef = false, isStatic = false;
+    auto baseType = ParseDeclSpec(isTypedef, &isStatic);
 
-    /// 此处的作用域是为了 函数的参数 和 函数的body
-    sema.EnterScope();
+    /// struct A {...};
+    if (tok.tokenType == TokenType::semi) {
+        Consume(TokenType::semi);
+        return nullptr;
+    }
+
+    /// 函数名之后是 '(' 时，DirectDeclarator 进入参数和函数体的作用域
+    externalDeclarator = true;
+    if (isTypedef) {
+        sema.SetMode(Sema::Mode::Skip);
+    }
     auto node = Declarator(baseType, true);
+    if (isTypedef) {
+        sema.UnSetMode();
+    }
+    externalDeclarator = false;
+
+    if (!std::exchange(funcScopeEntered, false)) {
+        return ParseInitDeclarators(baseType, isTypedef, true, node);
+    }
 
     /// 是否是 typedef 的函数声明
     if (isTypedef) {
@@ -34,16 +66,22 @@ std::shared_ptr<AstNode> Parser::ParseFuncDecl() {
         sema.ExitScope();
         sema.SemaTypedefDecl(node->ty, node->tok);
         return nullptr;
-    } else {
-        std::shared_ptr<AstNode> blockStmt = nullptr;
-        if (tok.tokenType != TokenType::semi) {
-            blockStmt = ParseBlockStmt();
-        }else {
-            Consume(TokenType::semi);
+    }
+    std::shared_ptr<AstNode> blockStmt = nullptr;
+    if (tok.tokenType == TokenType::l_brace) {
+        llvm::StringRef funcName(node->tok.ptr, node->tok.len);
+        llvm::TimeTraceScope timeScope("ParseFuncDecl", funcName);
+        blockStmt = ParseBlockStmt();
+        if (timeReport) {
+            timeReport->RecordFunction(funcName, TimeReport::kParse, startTime);
         }
-        sema.ExitScope();
-        return sema.SemaFuncDecl(node->tok, node->ty, blockStmt);
+    }else {
+        Consume(TokenType::semi);
     }
+    sema.ExitScope();
+    auto funcDecl = sema.SemaFuncDecl(node->tok, node->ty, blockStmt);
+    llvm::cast<FuncDecl>(funcDecl.get())->isStatic = isStatic;
+    return funcDecl;
 }
 
 std::shared_ptr<AstNode> Parser::ParseStmt() {
@@ -103,6 +141,7 @@ std::shared_ptr<AstNode> Parser::ParseStmt() {
 std::shared_ptr<AstNode> Parser::ParseBlockStmt() {
     sema.EnterScope();
     auto blockStmt = std::make_shared<BlockStmt>();
+    blockStmt->tok = tok;
 
     Consume(TokenType::l_brace);
     while (tok.tokenType != TokenType::r_brace) {
@@ -118,7 +157,7 @@ std::shared_ptr<AstNode> Parser::ParseBlockStmt() {
     return blockStmt;
 }
 
-std::shared_ptr<CType> Parser::ParseDeclSpec(bool &isTypedef) {
+std::shared_ptr<CType> Parser::ParseDeclSpec(bool &isTypedef, bool *isStatic) {
     if (!IsTypeName(tok)) {
         GetDiagEngine().Report(llvm::SMLoc::getFromPointer(tok.ptr), diag::err_type);
     }
@@ -155,7 +194,15 @@ std::shared_ptr<CType> Parser::ParseDeclSpec(bool &isTypedef) {
                 break;
             }
             case TokenType::kw_extern:  if (sclass) goto err; sclass = kExtern; Advance(); break;
-            case TokenType::kw_static:  if (sclass) goto err; sclass = kStatic; Advance(); break;
+            case TokenType::kw_static: {
+                if (sclass)
+                    goto err;
+                sclass = kStatic;
+                if (isStatic)
+                    *isStatic = true;
+                Advance();
+                break;
+            }
             case TokenType::kw_auto:  if (sclass) goto err; sclass = kAuto; Advance(); break;
             case TokenType::kw_register:  if (sclass) goto err; sclass = kRegister; Advance();break;
             case TokenType::kw_const: Advance(); break;
@@ -336,7 +383,8 @@ std::shared_ptr<CType> Parser::DirectDeclaratorFuncSuffix(Token iden, std::share
             Consume(TokenType::comma);
         }
 
-        if (tok.tokenType == TokenType::kw_void) {
+        /// (void) 表示没有参数，void *p 是普通的参数
+        if (tok.tokenType == TokenType::kw_void && PeekToken().tokenType == TokenType::r_parent) {
             Consume(TokenType::kw_void);
             break;
         }
@@ -381,26 +429,35 @@ std::shared_ptr<CType> Parser::DirectDeclaratorSuffix(Token iden, std::shared_pt
 std::shared_ptr<AstNode> Parser::DirectDeclarator(std::shared_ptr<CType> baseType, bool isGlobal) {
     std::shared_ptr<AstNode> declNode;
     if (tok.tokenType == TokenType::l_parent) {
-        Token beginTok = tok;
-        lexer.SaveState();
+        size_t state = SaveState();
         sema.SetMode(Sema::Mode::Skip);
+        /// 只是为了求出括号之后的类型，不能进入函数的作用域
+        bool savedExternalDeclarator = std::exchange(externalDeclarator, false);
         Consume(TokenType::l_parent);
         Declarator(CType::IntType, isGlobal);
         Consume(TokenType::r_parent);
 
-        baseType = DirectDeclaratorSuffix(tok, baseType, isGlobal); 
+        baseType = DirectDeclaratorSuffix(tok, baseType, isGlobal);
 
-        lexer.RestoreState();
+        RestoreState(state);
         sema.UnSetMode();
-        tok = beginTok;
+        externalDeclarator = savedExternalDeclarator;
 
         Consume(TokenType::l_parent);
         declNode = Declarator(baseType, isGlobal);
         Consume(TokenType::r_parent);
+        /// 类型已经求出来了，只需要跳过后缀; 参数的名字不能进入当前作用域
+        sema.SetMode(Sema::Mode::Skip);
         DirectDeclaratorSuffix(tok, CType::IntType, isGlobal);
+        sema.UnSetMode();
     }else if (tok.tokenType == TokenType::identifier){
         Token iden = tok;
         Consume(TokenType::identifier);
+        /// 外部声明的名字后面是 '(': 函数的参数和函数体在一个新的作用域中，由 ParseExternalDecl 退出
+        if (std::exchange(externalDeclarator, false) && tok.tokenType == TokenType::l_parent) {
+            sema.EnterScope();
+            funcScopeEntered = true;
+        }
         baseType = DirectDeclaratorSuffix(iden, baseType, isGlobal);
         declNode = sema.SemaVariableDeclNode(iden, baseType, isGlobal);
     }else {
@@ -420,7 +477,7 @@ std::shared_ptr<AstNode> Parser::DirectDeclarator(std::shared_ptr<CType> baseTyp
 void Parser::ParseStringInitializer(std::vector<std::shared_ptr<VariableDecl::InitValue>> &arr, std::shared_ptr<CType> declType, std::vector<int> &offsetList) {
     CArrayType *arrTy = llvm::dyn_cast<CArrayType>(declType.get());
     Token curTok = tok;
-    std::string strValue = tok.strVal;
+    std::string strValue = lexer.GetLiteral(tok).strVal;
     Consume(TokenType::str);
     if (arrTy->GetElementCount() < 0) {
         arrTy->SetElementCount(strValue.size() + 1);
@@ -560,12 +617,21 @@ std::shared_ptr<AstNode> Parser::ParseDeclStmt(bool isGlobal) {
         return nullptr;
     }
 
+    return ParseInitDeclarators(baseTy, isTypedef, isGlobal, nullptr);
+}
+
+std::shared_ptr<AstNode> Parser::ParseInitDeclarators(std::shared_ptr<CType> baseTy, bool isTypedef, bool isGlobal,
+                                                      std::shared_ptr<AstNode> first) {
     if (isTypedef) {
         int i = 0;
+        if (first) {
+            sema.SemaTypedefDecl(first->ty, first->tok);
+            ++i;
+        }
         
         while (tok.tokenType != TokenType::semi) {
             if (i++ > 0) {
-                assert(Consume(TokenType::comma));
+                Consume(TokenType::comma);
             }
             sema.SetMode(Sema::Mode::Skip);
             auto node = Declarator(baseTy, isGlobal);
@@ -584,9 +650,13 @@ std::shared_ptr<AstNode> Parser::ParseDeclStmt(bool isGlobal) {
         /// a,b=3; 
     
         int i = 0;
+        if (first) {
+            decl->nodeVec.push_back(first);
+            ++i;
+        }
         while (tok.tokenType != TokenType::semi) {
             if (i++ > 0) {
-                assert(Consume(TokenType::comma));
+                Consume(TokenType::comma);
             }
             decl->nodeVec.push_back(Declarator(baseTy, isGlobal));
         }
@@ -724,8 +794,9 @@ std::shared_ptr<AstNode> Parser::ParseBreakStmt() {
     if (breakNodes.size() == 0) {
         GetDiagEngine().Report(llvm::SMLoc::getFromPointer(tok.ptr), diag::err_break_stmt);
     }
-    Consume(TokenType::kw_break);
     auto node = std::make_shared<BreakStmt>();
+    node->tok = tok;
+    Consume(TokenType::kw_break);
     node->target = breakNodes.back(); 
     Consume(TokenType::semi);
     return node;
@@ -735,16 +806,18 @@ std::shared_ptr<AstNode> Parser::ParseContinueStmt() {
     if (breakNodes.size() == 0) {
         GetDiagEngine().Report(llvm::SMLoc::getFromPointer(tok.ptr), diag::err_continue_stmt);
     }
-    Consume(TokenType::kw_continue);
     auto node = std::make_shared<ContinueStmt>();
+    node->tok = tok;
+    Consume(TokenType::kw_continue);
     node->target = continueNodes.back();
     Consume(TokenType::semi);
     return node;
 }
 
 std::shared_ptr<AstNode> Parser::ParseReturnStmt() {
-    Consume(TokenType::kw_return);
     auto node = std::make_shared<ReturnStmt>();
+    node->tok = tok;
+    Consume(TokenType::kw_return);
     if (tok.tokenType != TokenType::semi) {
         node->expr = ParseExpr();
     }
@@ -928,14 +1001,8 @@ std::shared_ptr<AstNode> Parser::ParseCastExpr() {
         return ParseUnaryExpr();
     }
     bool isTypeName = false;
-    {
-        lexer.SaveState();
-        Token tmp;
-        lexer.NextToken(tmp);
-        if (IsTypeName(tmp)) {
-            isTypeName = true;
-        }
-        lexer.RestoreState();
+    if (IsTypeName(PeekToken())) {
+        isTypeName = true;
     }
 
     if (isTypeName) {
@@ -961,14 +1028,8 @@ std::shared_ptr<AstNode> Parser::ParseUnaryExpr() {
         bool isTypeName = false;
         Consume(TokenType::kw_sizeof);
 
-        if (tok.tokenType == TokenType::l_parent) {
-            lexer.SaveState();
-            Token nextTok;
-            lexer.NextToken(nextTok);
-            if (IsTypeName(nextTok)) {
-                isTypeName = true;
-            }
-            lexer.RestoreState();
+        if (tok.tokenType == TokenType::l_parent && IsTypeName(PeekToken())) {
+            isTypeName = true;
         }
 
         if (isTypeName) {
@@ -1096,13 +1157,14 @@ std::shared_ptr<AstNode> Parser::ParsePrimary() {
         return expr;
     }
     else if (tok.tokenType == TokenType::str) {
-        auto expr = sema.SemaStringExprNode(tok, tok.strVal, tok.ty);
+        const Literal &literal = lexer.GetLiteral(tok);
+        auto expr = sema.SemaStringExprNode(tok, literal.strVal, literal.ty);
         Consume(TokenType::str);
         return expr;
     }
     else {
         Expect(TokenType::number);
-        auto factor = sema.SemaNumberExprNode(tok, tok.ty);
+        auto factor = sema.SemaNumberExprNode(tok, lexer.GetLiteral(tok));
         Advance();
         return factor;
     }
@@ -1316,48 +1378,6 @@ bool Parser::IsTypeName(Token tok) {
     return false;
 }
 
-bool Parser::IsFuncDecl() {
-    sema.SetMode(Sema::Mode::Skip);
-    bool isFunc = false;
-    Token begin = tok;
-    lexer.SaveState();
-    bool isTypedef = false;
-    auto baseType = ParseDeclSpec(isTypedef);
-    if (tok.tokenType == TokenType::semi) {
-        isFunc = false;
-    }else {
-        auto node = Declarator(baseType, true);
-        isFunc = IsFuncTypeNode(node);
-    }
-    lexer.RestoreState();
-    tok = begin;
-    sema.UnSetMode();
-    return isFunc;
-}
-
-bool Parser::IsFuncTypeNode(std::shared_ptr<AstNode> node) {
-    if (node->ty->GetKind() == CType::TY_Func) {
-        return true;
-    }
-    CType *ty = node->ty.get();
-    while (ty->GetKind() == CType::TY_Point) {
-        CPointType *pty = llvm::dyn_cast<CPointType>(ty);
-        
-        if (pty->GetBaseType()->GetKind() == CType::TY_Point) {
-            ty = pty->GetBaseType().get(); 
-            continue;
-        }
-
-        if (pty->GetBaseType()->GetKind() == CType::TY_Func) {
-            return true;
-        }
-
-        break;
-    }
-
-    return false;
-}
-
 bool Parser::IsStringArrayType(std::shared_ptr<CType> ty) {
     if (ty->GetKind() == CType::TY_Array) {
         CArrayType *arrTy = llvm::dyn_cast<CArrayType>(ty.get());
@@ -1389,7 +1409,14 @@ bool Parser::Consume(TokenType tokenType) {
 }
 
 void Parser::Advance() {
-    lexer.NextToken(tok);
+    /// 停在 eof 上
+    if (pos + 1 < tokens.size()) {
+        tok = tokens[++pos];
+    }
+}
+
+const Token &Parser::PeekToken() const {
+    return tokens[std::min(pos + 1, tokens.size() - 1)];
 }
 
 void Parser::ConsumeTypeQualify() {
@@ -2,26 +2,38 @@
 #include "lexer.h"
 #include "ast.h"
 #include "sema.h"
+#include "time_report.h"
 class Parser {
 private:
     Lexer &lexer;
     Sema &sema;
+    /// -ftime-report, 为空时不计时
+    TimeReport *timeReport;
     std::vector<std::shared_ptr<AstNode>> breakNodes;
     std::vector<std::shared_ptr<AstNode>> continueNodes;
     std::vector<std::shared_ptr<AstNode>> switchNodes;
 public:
-    Parser(Lexer &lexer, Sema &sema) : lexer(lexer), sema(sema) {
-        Advance();
-    }
+    Parser(Lexer &lexer, Sema &sema, TimeReport *timeReport = nullptr);
+    /// tokens 已经扫描好 (例如经过了 Preprocessor)，最后一个必须是 eof
+    Parser(Lexer &lexer, Sema &sema, std::vector<Token> tokens, TimeReport *timeReport = nullptr);
 
     std::shared_ptr<Program> ParseProgram();
 
+    size_t GetNumTokens() const {
+        return tokens.size();
+    }
+
 private:
-    std::shared_ptr<AstNode> ParseFuncDecl();
+    /// 函数定义/声明，全局变量，typedef
+    std::shared_ptr<AstNode> ParseExternalDecl();
     std::shared_ptr<AstNode> ParseStmt();
     std::shared_ptr<AstNode> ParseBlockStmt();
     std::shared_ptr<AstNode> ParseDeclStmt(bool isGlobal = false);
-    std::shared_ptr<CType> ParseDeclSpec(bool &isTypedef);
+    /// decl-spec 之后以逗号分隔的声明符，first 是已经解析过的第一个
+    std::shared_ptr<AstNode> ParseInitDeclarators(std::shared_ptr<CType> baseTy, bool isTypedef, bool isGlobal,
+                                                  std::shared_ptr<AstNode> first);
+    /// isStatic 不为空时记录是否有 static
+    std::shared_ptr<CType> ParseDeclSpec(bool &isTypedef, bool *isStatic = nullptr);
     std::shared_ptr<CType> ParseStructOrUnionSpec();
     std::shared_ptr<AstNode> Declarator(std::shared_ptr<CType> baseType, bool isGlobal);
     std::shared_ptr<AstNode> DirectDeclarator(std::shared_ptr<CType> baseType, bool isGlobal);
@@ -69,9 +81,6 @@ private:
 
     bool IsTypeName(Token tok);
 
-    bool IsFuncDecl();
-    bool IsFuncTypeNode(std::shared_ptr<AstNode> node);
-
     bool IsStringArrayType(std::shared_ptr<CType> ty);
 
     /// 消费 token 的函数
@@ -81,6 +90,17 @@ private:
     bool Consume(TokenType tokenType);
     /// 前进一个 token
     void Advance();
+    /// 当前 token 的下一个，不会消费
+    const Token &PeekToken() const;
+
+    /// 回溯: tokens 在构造时已经全部生成，保存/恢复只是一个下标
+    size_t SaveState() const {
+        return pos;
+    }
+    void RestoreState(size_t state) {
+        pos = state;
+        tok = tokens[pos];
+    }
 
     void ConsumeTypeQualify();
 
@@ -88,5 +108,12 @@ private:
         return lexer.GetDiagEngine();
     }
 
+    std::vector<Token> tokens;
+    size_t pos{0};
     Token tok;
+
+    /// 正在解析外部声明的第一个声明符
+    bool externalDeclarator{false};
+    /// 第一个声明符是函数，已经进入了参数和函数体的作用域
+    bool funcScopeEntered{false};
 };
\ No newline at end of file
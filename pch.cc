@@ -0,0 +1,391 @@
+#include "pch.h"
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+/// 类型在 typeData 中的编码 (第一个字是 kind | flags << 8):
+///   基本类型: kind
+///   指针:     kind, base
+///   数组:     kind, element, count
+///   struct/union: kind | tagKind << 8, name, nameLen, n, (type, name, nameLen) * n
+///   函数:     kind | isVarArg << 8, ret, name, nameLen, n, (type, name, nameLen) * n
+/// struct 可以通过指针引用自身，所以类型的下标在编码它的成员之前分配
+
+uint32_t PCHWriter::AddString(llvm::StringRef str) {
+    auto it = stringOffsets.find(str);
+    if (it != stringOffsets.end()) {
+        return it->second;
+    }
+    uint32_t offset = strings.size();
+    strings += str;
+    stringOffsets[str] = offset;
+    return offset;
+}
+
+uint32_t PCHWriter::AddType(CType *ty) {
+    auto it = typeIds.find(ty);
+    if (it != typeIds.end()) {
+        return it->second;
+    }
+    uint32_t id = typeOffsets.size();
+    typeIds[ty] = id;
+    typeOffsets.push_back(typeData.size());
+
+    /// 先占好这个类型的位置，递归编码子类型时 typeData 会增长
+    auto reserve = [&](size_t n) {
+        size_t pos = typeData.size();
+        typeData.resize(pos + n);
+        return pos;
+    };
+    auto addString = [&](size_t pos, llvm::StringRef str) {
+        uint32_t offset = AddString(str);
+        typeData[pos] = offset;
+        typeData[pos + 1] = str.size();
+    };
+
+    switch (ty->GetKind()) {
+    case CType::TY_Point: {
+        size_t pos = reserve(2);
+        typeData[pos] = ty->GetKind();
+        uint32_t base = AddType(llvm::cast<CPointType>(ty)->GetBaseType().get());
+        typeData[pos + 1] = base;
+        break;
+    }
+    case CType::TY_Array: {
+        auto *arrTy = llvm::cast<CArrayType>(ty);
+        size_t pos = reserve(3);
+        typeData[pos] = ty->GetKind();
+        typeData[pos + 2] = arrTy->GetElementCount();
+        uint32_t element = AddType(arrTy->GetElementType().get());
+        typeData[pos + 1] = element;
+        break;
+    }
+    case CType::TY_Record: {
+        auto *recordTy = llvm::cast<CRecordType>(ty);
+        const auto &members = recordTy->GetMembers();
+        size_t pos = reserve(4 + 3 * members.size());
+        typeData[pos] = ty->GetKind() | (uint32_t)recordTy->GetTagKind() << 8;
+        addString(pos + 1, recordTy->GetName());
+        typeData[pos + 3] = members.size();
+        for (size_t i = 0; i < members.size(); ++i) {
+            size_t memberPos = pos + 4 + 3 * i;
+            uint32_t memberTy = AddType(members[i].ty.get());
+            typeData[memberPos] = memberTy;
+            addString(memberPos + 1, members[i].name);
+        }
+        break;
+    }
+    case CType::TY_Func: {
+        auto *funcTy = llvm::cast<CFuncType>(ty);
+        const auto &params = funcTy->GetParams();
+        size_t pos = reserve(5 + 3 * params.size());
+        typeData[pos] = ty->GetKind() | (uint32_t)funcTy->IsVarArg() << 8;
+        uint32_t retTy = AddType(funcTy->GetRetType().get());
+        typeData[pos + 1] = retTy;
+        addString(pos + 2, funcTy->GetName());
+        typeData[pos + 4] = params.size();
+        for (size_t i = 0; i < params.size(); ++i) {
+            size_t paramPos = pos + 5 + 3 * i;
+            uint32_t paramTy = AddType(params[i].type.get());
+            typeData[paramPos] = paramTy;
+            addString(paramPos + 1, params[i].name);
+        }
+        break;
+    }
+    default:
+        typeData[reserve(1)] = ty->GetKind();
+        break;
+    }
+    return id;
+}
+
+void PCHWriter::AddSymbols(const llvm::StringMap<std::shared_ptr<Symbol>> &table,
+                           std::vector<pch::SymbolEntry> &entries) {
+    std::vector<std::pair<llvm::StringRef, Symbol *>> symbols;
+    for (const auto &entry : table) {
+        /// 匿名 struct/union 只能通过 typedef 或者变量引用，它在 tag 表中的名字不需要查找
+        if (auto *recordTy = llvm::dyn_cast<CRecordType>(entry.second->GetTy().get());
+            entry.second->GetKind() == SymbolKind::ktag && recordTy && CType::IsAnonyRecordName(recordTy->GetName())) {
+            continue;
+        }
+        symbols.push_back({entry.getKey(), entry.second.get()});
+    }
+    /// StringMap 的遍历顺序不固定，排序之后同样的头文件总是生成同样的文件，读取时也可以二分查找
+    std::sort(symbols.begin(), symbols.end(),
+              [](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+    for (const auto &[name, symbol] : symbols) {
+        pch::SymbolEntry entry;
+        entry.name = AddString(name);
+        entry.nameLen = name.size();
+        entry.kind = (uint32_t)symbol->GetKind();
+        entry.type = AddType(symbol->GetTy().get());
+        entries.push_back(entry);
+    }
+}
+
+/// 以换行连接，Write 和 Open 使用同样的方式比较 options
+static std::string JoinLines(llvm::ArrayRef<std::string> lines) {
+    std::string text;
+    for (const auto &line : lines) {
+        text += line + "\n";
+    }
+    return text;
+}
+
+/// 修改时间使用纳秒，同一秒内的修改也能发现
+static uint64_t GetModificationTime(const llvm::sys::fs::file_status &status) {
+    return status.getLastModificationTime().time_since_epoch().count();
+}
+
+bool PCHWriter::Write(const Scope &scope, llvm::StringRef macros, llvm::ArrayRef<std::string> includedFiles,
+                      llvm::ArrayRef<std::string> options, llvm::StringRef path) {
+    const Env &env = scope.GetGlobalEnv();
+    std::vector<pch::SymbolEntry> objSymbols, tagSymbols;
+    AddSymbols(env.objSymbolTable, objSymbols);
+    AddSymbols(env.tagSymbolTable, tagSymbols);
+
+    pch::Header header;
+    std::copy(std::begin(pch::kMagic), std::end(pch::kMagic), header.magic);
+    header.version = pch::kVersion;
+    header.numTypes = typeOffsets.size();
+    header.numObjSymbols = objSymbols.size();
+    header.numTagSymbols = tagSymbols.size();
+    header.typeDataSize = typeData.size();
+    header.macros = strings.size();
+    header.macrosLen = macros.size();
+    strings += macros;
+    std::string files;
+    for (const auto &file : includedFiles) {
+        llvm::sys::fs::file_status status;
+        if (std::error_code ec = llvm::sys::fs::status(file, status)) {
+            llvm::WithColor::error() << "can't stat '" << file << "': " << ec.message() << "\n";
+            return false;
+        }
+        files += std::to_string(status.getSize()) + " " + std::to_string(GetModificationTime(status)) + " " + file + "\n";
+    }
+    header.includedFiles = strings.size();
+    header.includedFilesLen = files.size();
+    strings += files;
+    std::string optionText = JoinLines(options);
+    header.options = strings.size();
+    header.optionsLen = optionText.size();
+    strings += optionText;
+    header.stringSize = strings.size();
+
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_None);
+    if (ec) {
+        llvm::WithColor::error() << "Can not open file '" << path << "': " << ec.message() << "\n";
+        return false;
+    }
+    auto writeWords = [&](const std::vector<uint32_t> &words) {
+        for (uint32_t word : words) {
+            pch::Word le;
+            le = word;
+            os.write(reinterpret_cast<const char *>(&le), sizeof(le));
+        }
+    };
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    writeWords(typeOffsets);
+    os.write(reinterpret_cast<const char *>(objSymbols.data()), objSymbols.size() * sizeof(pch::SymbolEntry));
+    os.write(reinterpret_cast<const char *>(tagSymbols.data()), tagSymbols.size() * sizeof(pch::SymbolEntry));
+    writeWords(typeData);
+    os << strings;
+    os.close();
+    if (os.has_error()) {
+        llvm::WithColor::error() << "Can not write file '" << path << "'\n";
+        os.clear_error();
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<PCHFile> PCHFile::Open(llvm::StringRef path, llvm::ArrayRef<std::string> options) {
+    /// 文件较大时 MemoryBuffer 使用 mmap，不需要 '\0' 结尾
+    auto bufOrErr = llvm::MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (!bufOrErr) {
+        llvm::WithColor::error() << "can't open file '" << path << "'\n";
+        return nullptr;
+    }
+    auto file = std::make_unique<PCHFile>();
+    file->buffer = std::move(*bufOrErr);
+    llvm::StringRef data = file->buffer->getBuffer();
+
+    auto invalid = [&](llvm::StringRef reason) -> std::unique_ptr<PCHFile> {
+        llvm::WithColor::error() << "'" << path << "' is not a valid precompiled header: " << reason << "\n";
+        return nullptr;
+    };
+    if (data.size() < sizeof(pch::Header) || !std::equal(std::begin(pch::kMagic), std::end(pch::kMagic), data.data())) {
+        return invalid("bad magic");
+    }
+    const auto *header = reinterpret_cast<const pch::Header *>(data.data());
+    if (header->version != pch::kVersion) {
+        return invalid("version mismatch, regenerate it with --emit-pch");
+    }
+    uint64_t size = sizeof(pch::Header) + (uint64_t)header->numTypes * sizeof(pch::Word) +
+                    ((uint64_t)header->numObjSymbols + header->numTagSymbols) * sizeof(pch::SymbolEntry) +
+                    (uint64_t)header->typeDataSize * sizeof(pch::Word) + header->stringSize;
+    if (size != data.size() || (uint64_t)header->macros + header->macrosLen > header->stringSize ||
+        (uint64_t)header->includedFiles + header->includedFilesLen > header->stringSize ||
+        (uint64_t)header->options + header->optionsLen > header->stringSize) {
+        return invalid("truncated file");
+    }
+
+    const char *cur = data.data() + sizeof(pch::Header);
+    file->header = header;
+    file->typeOffsets = reinterpret_cast<const pch::Word *>(cur);
+    cur += header->numTypes * sizeof(pch::Word);
+    file->objSymbols = reinterpret_cast<const pch::SymbolEntry *>(cur);
+    cur += header->numObjSymbols * sizeof(pch::SymbolEntry);
+    file->tagSymbols = reinterpret_cast<const pch::SymbolEntry *>(cur);
+    cur += header->numTagSymbols * sizeof(pch::SymbolEntry);
+    file->typeData = reinterpret_cast<const pch::Word *>(cur);
+    cur += header->typeDataSize * sizeof(pch::Word);
+    file->strings = cur;
+
+    if (llvm::StringRef(file->strings + header->options, header->optionsLen) != JoinLines(options)) {
+        return invalid("-D/-I options differ from the ones it was built with, regenerate it with --emit-pch");
+    }
+
+    file->macros = llvm::StringRef(file->strings + header->macros, header->macrosLen);
+    llvm::StringRef files(file->strings + header->includedFiles, header->includedFilesLen);
+    while (!files.empty()) {
+        auto [line, rest] = files.split('\n');
+        files = rest;
+        auto [sizeText, afterSize] = line.split(' ');
+        auto [timeText, filePath] = afterSize.split(' ');
+        uint64_t fileSize, fileTime;
+        if (sizeText.getAsInteger(10, fileSize) || timeText.getAsInteger(10, fileTime) || filePath.empty()) {
+            return invalid("corrupted file list");
+        }
+        llvm::sys::fs::file_status status;
+        if (llvm::sys::fs::status(filePath, status) || status.getSize() != fileSize ||
+            GetModificationTime(status) != fileTime) {
+            return invalid(("'" + filePath + "' has changed, regenerate it with --emit-pch").str());
+        }
+        file->includedFiles.push_back(filePath);
+    }
+    return file;
+}
+
+std::shared_ptr<Symbol> PCHReader::FindObjSymbol(llvm::StringRef name) {
+    return FindSymbol(file.objSymbols, file.header->numObjSymbols, name);
+}
+
+std::shared_ptr<Symbol> PCHReader::FindTagSymbol(llvm::StringRef name) {
+    return FindSymbol(file.tagSymbols, file.header->numTagSymbols, name);
+}
+
+std::shared_ptr<Symbol> PCHReader::FindSymbol(const pch::SymbolEntry *entries, uint32_t count, llvm::StringRef name) {
+    auto nameOf = [&](const pch::SymbolEntry &entry) {
+        if ((uint64_t)entry.name + entry.nameLen > file.header->stringSize) {
+            llvm::report_fatal_error("corrupted precompiled header");
+        }
+        return llvm::StringRef(file.strings + entry.name, entry.nameLen);
+    };
+    const pch::SymbolEntry *end = entries + count;
+    const pch::SymbolEntry *it = std::lower_bound(entries, end, name, [&](const pch::SymbolEntry &entry, llvm::StringRef name) {
+        return nameOf(entry) < name;
+    });
+    if (it == end || nameOf(*it) != name) {
+        return nullptr;
+    }
+    /// 名字指向 mmap 的文件，和文件的生命周期相同
+    return std::make_shared<Symbol>((SymbolKind)(uint32_t)it->kind, GetType(it->type), nameOf(*it));
+}
+
+uint32_t PCHReader::ReadWord(uint32_t pos) {
+    if (pos >= file.header->typeDataSize) {
+        llvm::report_fatal_error("corrupted precompiled header");
+    }
+    return file.typeData[pos];
+}
+
+llvm::StringRef PCHReader::ReadString(uint32_t pos) {
+    uint32_t offset = ReadWord(pos), len = ReadWord(pos + 1);
+    if ((uint64_t)offset + len > file.header->stringSize) {
+        llvm::report_fatal_error("corrupted precompiled header");
+    }
+    return llvm::StringRef(file.strings + offset, len);
+}
+
+std::shared_ptr<CType> PCHReader::GetType(uint32_t id) {
+    auto it = types.find(id);
+    if (it != types.end()) {
+        return it->second;
+    }
+    if (id >= file.header->numTypes) {
+        llvm::report_fatal_error("corrupted precompiled header");
+    }
+    uint32_t pos = file.typeOffsets[id];
+    uint32_t word = ReadWord(pos);
+    uint32_t flags = word >> 8;
+
+    std::shared_ptr<CType> ty;
+    switch ((CType::Kind)(word & 0xff)) {
+    case CType::TY_Void: ty = CType::VoidType; break;
+    case CType::TY_Char: ty = CType::CharType; break;
+    case CType::TY_UChar: ty = CType::UCharType; break;
+    case CType::TY_Short: ty = CType::ShortType; break;
+    case CType::TY_UShort: ty = CType::UShortType; break;
+    case CType::TY_Int: ty = CType::IntType; break;
+    case CType::TY_UInt: ty = CType::UIntType; break;
+    case CType::TY_Long: ty = CType::LongType; break;
+    case CType::TY_ULong: ty = CType::ULongType; break;
+    case CType::TY_LLong: ty = CType::LongLongType; break;
+    case CType::TY_ULLong: ty = CType::ULongLongType; break;
+    case CType::TY_Float: ty = CType::FloatType; break;
+    case CType::TY_Double: ty = CType::DoubleType; break;
+    case CType::TY_LDouble: ty = CType::LDoubleType; break;
+    case CType::TY_Point:
+        ty = std::make_shared<CPointType>(GetType(ReadWord(pos + 1)));
+        break;
+    case CType::TY_Array:
+        ty = std::make_shared<CArrayType>(GetType(ReadWord(pos + 1)), ReadWord(pos + 2));
+        break;
+    case CType::TY_Record: {
+        TagKind tagKind = (TagKind)flags;
+        llvm::StringRef name = ReadString(pos + 1);
+        /// 匿名类型的名字在每个编译单元中重新生成，避免和这个编译单元自己的匿名类型重名
+        if (CType::IsAnonyRecordName(name)) {
+            name = CType::GenAnonyRecordName(tagKind);
+        }
+        auto recordTy = std::make_shared<CRecordType>(name, std::vector<Member>{}, tagKind);
+        /// 成员可能通过指针引用这个 struct 自身
+        types[id] = recordTy;
+        uint32_t count = ReadWord(pos + 3);
+        std::vector<Member> members;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t memberPos = pos + 4 + 3 * i;
+            Member member;
+            member.ty = GetType(ReadWord(memberPos));
+            member.name = ReadString(memberPos + 1);
+            members.push_back(member);
+        }
+        recordTy->SetMembers(members);
+        return recordTy;
+    }
+    case CType::TY_Func: {
+        std::shared_ptr<CType> retTy = GetType(ReadWord(pos + 1));
+        llvm::StringRef name = ReadString(pos + 2);
+        uint32_t count = ReadWord(pos + 4);
+        std::vector<Param> params;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t paramPos = pos + 5 + 3 * i;
+            Param param;
+            param.type = GetType(ReadWord(paramPos));
+            param.name = ReadString(paramPos + 1);
+            params.push_back(param);
+        }
+        ty = std::make_shared<CFuncType>(retTy, params, name, flags != 0);
+        break;
+    }
+    default:
+        llvm::report_fatal_error("corrupted precompiled header");
+    }
+    types[id] = ty;
+    return ty;
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include "scope.h"
+#include "type.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/// 预编译头 (--emit-pch/--include-pch)
+/// 头文件解析之后，全局作用域中的 typedef、struct/union 和函数声明连同它们引用的类型序列化成一个紧凑的二进制文件。
+/// 使用时整个文件 mmap 进来，不做任何解析; Scope 查找不到某个名字时才二分查找符号表，反序列化这个符号和它引用的类型。
+/// 头文件中的宏以 #define 文本的形式保存，包含过的头文件在使用预编译头的编译单元中不会再被 #include
+/// 包含过的头文件的大小和修改时间、生成时的 -D/-I 也保存下来，打开时任何一个不一致都说明预编译头已经过期
+///
+/// 文件布局 (全部是 4 字节对齐的小端整数):
+///   Header | typeOffsets[numTypes] | objSymbols[numObjSymbols] | tagSymbols[numTagSymbols] | typeData[typeDataSize] | strings
+/// 符号表按名字排序; 每个类型在 typeData 中以 kind 开头，引用其它类型时使用类型的下标，字符串是 strings 中的 (offset, length)
+namespace pch {
+using Word = llvm::support::ulittle32_t;
+
+constexpr char kMagic[4] = {'S', 'P', 'C', 'H'};
+/// 格式或者 CType 的布局改变时加 1
+constexpr uint32_t kVersion = 2;
+
+struct Header {
+    char magic[4];
+    Word version;
+    Word numTypes;
+    Word numObjSymbols;
+    Word numTagSymbols;
+    Word typeDataSize;
+    Word stringSize;
+    /// 宏定义，每行一个 #define
+    Word macros;
+    Word macrosLen;
+    /// 包含过的头文件，每行是 "大小 修改时间(ns) 规范化之后的路径"
+    Word includedFiles;
+    Word includedFilesLen;
+    /// 生成时的 -D/-I 选项，以换行分隔
+    Word options;
+    Word optionsLen;
+};
+
+struct SymbolEntry {
+    Word name;
+    Word nameLen;
+    Word kind;
+    Word type;
+};
+}
+
+class PCHWriter {
+private:
+    llvm::DenseMap<CType *, uint32_t> typeIds;
+    std::vector<uint32_t> typeOffsets;
+    std::vector<uint32_t> typeData;
+    std::string strings;
+    llvm::StringMap<uint32_t> stringOffsets;
+public:
+    /// 序列化 scope 的全局作用域，失败时打印错误
+    /// 调用者需要保证全局作用域中只有 typedef、struct/union 和没有函数体的函数声明
+    /// options 是影响预处理结果的 -D/-I 选项，使用预编译头时必须相同
+    bool Write(const Scope &scope, llvm::StringRef macros, llvm::ArrayRef<std::string> includedFiles,
+               llvm::ArrayRef<std::string> options, llvm::StringRef path);
+private:
+    uint32_t AddType(CType *ty);
+    uint32_t AddString(llvm::StringRef str);
+    void AddSymbols(const llvm::StringMap<std::shared_ptr<Symbol>> &table, std::vector<pch::SymbolEntry> &entries);
+};
+
+/// mmap 进来的预编译头，只读，可以被多个编译单元 (线程) 共享
+class PCHFile {
+private:
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+public:
+    const pch::Header *header{nullptr};
+    const pch::Word *typeOffsets{nullptr};
+    const pch::SymbolEntry *objSymbols{nullptr};
+    const pch::SymbolEntry *tagSymbols{nullptr};
+    const pch::Word *typeData{nullptr};
+    const char *strings{nullptr};
+    llvm::StringRef macros;
+    std::vector<llvm::StringRef> includedFiles;
+
+    /// 文件不存在、格式或版本不对，或者已经过期 (头文件被修改、options 与生成时不同) 时打印错误，返回 nullptr
+    static std::unique_ptr<PCHFile> Open(llvm::StringRef path, llvm::ArrayRef<std::string> options = {});
+
+    llvm::StringRef GetBuffer() const {
+        return buffer->getBuffer();
+    }
+};
+
+/// 一个编译单元对预编译头的访问，反序列化出来的类型只属于这个编译单元
+class PCHReader : public ExternalSymbolSource {
+private:
+    const PCHFile &file;
+    llvm::DenseMap<uint32_t, std::shared_ptr<CType>> types;
+public:
+    PCHReader(const PCHFile &file) : file(file) {}
+
+    std::shared_ptr<Symbol> FindObjSymbol(llvm::StringRef name) override;
+    std::shared_ptr<Symbol> FindTagSymbol(llvm::StringRef name) override;
+
+    /// 已经反序列化的类型个数
+    size_t GetNumLoadedTypes() const {
+        return types.size();
+    }
+private:
+    std::shared_ptr<Symbol> FindSymbol(const pch::SymbolEntry *entries, uint32_t count, llvm::StringRef name);
+    std::shared_ptr<CType> GetType(uint32_t id);
+    uint32_t ReadWord(uint32_t pos);
+    /// pos 处是一个字符串的 (offset, length)
+    llvm::StringRef ReadString(uint32_t pos);
+};
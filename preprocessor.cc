@@ -0,0 +1,951 @@
+#include "preprocessor.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+/// #include 的最大嵌套深度，超过时多半是没有 include guard 的递归包含
+static constexpr size_t kMaxIncludeDepth = 200;
+
+/// defined X 替换成的数字 token 指向这里
+static const char kTrueText[] = "1";
+static const char kFalseText[] = "0";
+
+/// str token 的 ptr 在左引号之后
+static const char *GetStart(const Token &tok) {
+    return tok.tokenType == TokenType::str ? tok.ptr - 1 : tok.ptr;
+}
+
+static const char *GetEnd(const Token &tok) {
+    return tok.ptr + tok.len;
+}
+
+static llvm::StringRef GetSpelling(const Token &tok) {
+    return llvm::StringRef(GetStart(tok), GetEnd(tok) - GetStart(tok));
+}
+
+/// 标识符和关键字都可以作为宏名
+static bool IsIdentifierLike(const Token &tok) {
+    if (tok.tokenType == TokenType::number || tok.tokenType == TokenType::str || tok.len == 0) {
+        return false;
+    }
+    return isalpha(tok.ptr[0]) || tok.ptr[0] == '_';
+}
+
+static bool IsDirective(llvm::ArrayRef<Token> tokens, size_t i) {
+    return tokens[i].tokenType == TokenType::hash && Preprocessor::IsLineStart(tokens[i]) &&
+           i + 1 < tokens.size() && !Preprocessor::IsNewLine(tokens[i], tokens[i + 1]);
+}
+
+bool Preprocessor::IsLineStart(const Token &tok) {
+    const char *start = GetStart(tok);
+    for (const char *p = start - (tok.col - 1); p < start; ++p) {
+        if (*p != ' ' && *p != '\t' && *p != '\r' && *p != '\f' && *p != '\v') {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Preprocessor::IsNewLine(const Token &prev, const Token &tok) {
+    if (prev.row == tok.row) {
+        return false;
+    }
+    const char *begin = GetEnd(prev), *end = GetStart(tok);
+    if (begin > end) {
+        return true;
+    }
+    for (const char *p = begin; p < end; ++p) {
+        p = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!p) {
+            return false;
+        }
+        const char *q = p;
+        if (q > begin && q[-1] == '\r') {
+            --q;
+        }
+        if (q == begin || q[-1] != '\\') {
+            return true;
+        }
+    }
+    return false;
+}
+
+llvm::StringRef Preprocessor::DetectIncludeGuard(llvm::ArrayRef<Token> tokens) {
+    size_t n = tokens.size();
+    if (n < 3 || !IsDirective(tokens, 0) || GetSpelling(tokens[1]) != "ifndef" || !IsIdentifierLike(tokens[2])) {
+        return {};
+    }
+    int depth = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!IsDirective(tokens, i)) {
+            continue;
+        }
+        llvm::StringRef name = GetSpelling(tokens[i + 1]);
+        if (name == "if" || name == "ifdef" || name == "ifndef") {
+            ++depth;
+        } else if (depth == 1 && (name == "elif" || name == "else")) {
+            return {};
+        } else if (name == "endif" && --depth == 0) {
+            /// 最外层的 #endif 之后不能再有别的 token
+            size_t j = i + 2;
+            while (j < n && !IsNewLine(tokens[j - 1], tokens[j])) {
+                ++j;
+            }
+            return j == n ? GetSpelling(tokens[2]) : llvm::StringRef();
+        }
+    }
+    return {};
+}
+
+const CachedHeader *HeaderCache::Get(llvm::StringRef path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = headers.find(path);
+    if (it != headers.end()) {
+        return it->second.get();
+    }
+
+    auto buf = llvm::MemoryBuffer::getFile(path);
+    if (!buf) {
+        return nullptr;
+    }
+    auto header = std::make_unique<CachedHeader>();
+    header->path = path.str();
+    header->buffer = std::move(*buf);
+
+    /// 扫描时的诊断信息只能指向这个临时的 mgr，词法错误在这里就会报告
+    llvm::SourceMgr mgr;
+    mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(header->buffer->getMemBufferRef(), false), llvm::SMLoc());
+    DiagEngine diagEngine(mgr);
+    Lexer lexer(mgr, diagEngine);
+    lexer.Tokenize(header->tokens);
+    header->tokens.pop_back();
+
+    llvm::ArrayRef<Token> tokens = header->tokens;
+    header->guard = Preprocessor::DetectIncludeGuard(tokens).str();
+    for (size_t i = 0; i + 2 < tokens.size(); ++i) {
+        if (IsDirective(tokens, i) && GetSpelling(tokens[i + 1]) == "pragma" &&
+            GetSpelling(tokens[i + 2]) == "once" && !Preprocessor::IsNewLine(tokens[i + 1], tokens[i + 2])) {
+            header->pragmaOnce = true;
+            break;
+        }
+    }
+
+    const CachedHeader *result = header.get();
+    headers[path] = std::move(header);
+    return result;
+}
+
+Preprocessor::Preprocessor(Lexer &lexer, HeaderCache &cache, llvm::ArrayRef<std::string> includeDirs,
+                           llvm::ArrayRef<std::string> defines)
+    : lexer(lexer), mgr(lexer.GetSourceMgr()), diagEngine(lexer.GetDiagEngine()), cache(cache),
+      includeDirs(includeDirs.begin(), includeDirs.end()) {
+    for (llvm::StringRef define : defines) {
+        auto [name, value] = define.split('=');
+        predefines += "#define " + name.str() + " " + (define.contains('=') ? value.str() : "1") + "\n";
+    }
+}
+
+void Preprocessor::Tokenize(std::vector<Token> &tokens) {
+    /// 没有预处理指令时就是普通的扫描，不付出任何额外的开销
+    llvm::StringRef buf = mgr.getMemoryBuffer(mgr.getMainFileID())->getBuffer();
+    if (IsPlainSource(buf, !predefines.empty())) {
+        lexer.Tokenize(tokens);
+        return;
+    }
+
+    auto mainTokens = std::make_unique<std::vector<Token>>();
+    lexer.Tokenize(*mainTokens);
+    Token eof = mainTokens->back();
+    mainTokens->pop_back();
+    const Token *begin = mainTokens->data(), *end = begin + mainTokens->size();
+    tokens.reserve(tokens.size() + mainTokens->size() + 1);
+    PushFile(begin, end, std::move(mainTokens), llvm::sys::path::parent_path(lexer.GetFileName()));
+
+    if (!predefines.empty()) {
+        auto defineTokens = std::make_unique<std::vector<Token>>();
+        LexScratch(predefines, llvm::SMLoc(), *defineTokens, "<command line>");
+        begin = defineTokens->data();
+        end = begin + defineTokens->size();
+        PushFile(begin, end, std::move(defineTokens), "");
+    }
+
+    size_t first = tokens.size();
+    Run(tokens);
+    if (tokens.size() > first) {
+        eof = tokens.back();
+        eof.tokenType = TokenType::eof;
+    }
+    tokens.push_back(eof);
+}
+
+void Preprocessor::AddPrecompiled(llvm::StringRef macroDefinitions, llvm::ArrayRef<llvm::StringRef> includedFiles) {
+    predefines.insert(0, macroDefinitions.str());
+    for (llvm::StringRef path : includedFiles) {
+        precompiled.insert(path);
+    }
+}
+
+std::string Preprocessor::GetMacroDefinitions() const {
+    std::string text;
+    for (const auto &entry : macros) {
+        const Macro &macro = entry.second;
+        text += "#define ";
+        text += entry.first();
+        if (macro.isFunction) {
+            text += '(';
+            for (size_t i = 0; i < macro.params.size(); ++i) {
+                if (i > 0) {
+                    text += ", ";
+                }
+                text += macro.isVariadic && i + 1 == macro.params.size() ? "..." : macro.params[i].str();
+            }
+            text += ')';
+        }
+        for (size_t i = 0; i < macro.body.size(); ++i) {
+            /// 保留 token 之间有没有空白，# 和 ## 的结果依赖这一点
+            if (i == 0 || GetStart(macro.body[i]) != GetEnd(macro.body[i - 1])) {
+                text += ' ';
+            }
+            text += GetSpelling(macro.body[i]);
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+std::vector<std::string> Preprocessor::GetIncludedFiles() const {
+    std::vector<std::string> files;
+    for (const auto &entry : addedBuffers) {
+        files.push_back(entry.getKey().str());
+    }
+    return files;
+}
+
+void Preprocessor::Run(std::vector<Token> &out) {
+    while (frames.size() > baseDepth) {
+        Frame &frame = frames.back();
+        if (frame.cur == frame.end) {
+            PopFrame();
+            continue;
+        }
+        Token tok = *frame.cur++;
+        if (frame.isFile) {
+            if (tok.tokenType == TokenType::hash && IsLineStart(tok)) {
+                HandleDirective(frames.size() - 1, tok);
+                continue;
+            }
+            if (!IsActive()) {
+                continue;
+            }
+        }
+        if (Macro *macro = FindMacro(tok)) {
+            if (ExpandMacro(*macro, tok)) {
+                continue;
+            }
+        }
+        out.push_back(tok);
+    }
+}
+
+void Preprocessor::PushFile(const Token *begin, const Token *end, std::unique_ptr<std::vector<Token>> owned,
+                            llvm::StringRef dir) {
+    Frame frame;
+    frame.cur = begin;
+    frame.end = end;
+    frame.owned = std::move(owned);
+    frame.isFile = true;
+    frame.dir = dir.str();
+    frame.condDepth = conds.size();
+    frames.push_back(std::move(frame));
+}
+
+void Preprocessor::PopFrame() {
+    Frame &frame = frames.back();
+    if (frame.macro) {
+        frame.macro->disabled = false;
+    }
+    if (frame.isFile && conds.size() > frame.condDepth) {
+        diagEngine.Report(llvm::SMLoc::getFromPointer(conds.back().loc), diag::err_pp_unterminated_conditional);
+    }
+    frames.pop_back();
+}
+
+/// 宏参数可以跨越宏展开的边界，但不能越过文件末尾和 baseDepth
+bool Preprocessor::NextToken(Token &tok) {
+    while (frames.size() > baseDepth) {
+        Frame &frame = frames.back();
+        if (frame.cur != frame.end) {
+            tok = *frame.cur++;
+            return true;
+        }
+        if (frame.isFile) {
+            return false;
+        }
+        PopFrame();
+    }
+    return false;
+}
+
+const Token *Preprocessor::PeekToken() const {
+    for (size_t i = frames.size(); i > baseDepth; --i) {
+        const Frame &frame = frames[i - 1];
+        if (frame.cur != frame.end) {
+            return frame.cur;
+        }
+        if (frame.isFile) {
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+void Preprocessor::HandleDirective(size_t frameIdx, const Token &hash) {
+    /// 指令一直到行尾 (续行符已经在扫描时当作空白)
+    Frame &frame = frames[frameIdx];
+    const Token *begin = frame.cur, *p = begin;
+    for (const Token *prev = &hash; p != frame.end && !IsNewLine(*prev, *p); prev = p++) {
+    }
+    frame.cur = p;
+    /// 展开 #if 表达式和 #include 会压入新的 frame，之后不能再使用 frame
+    size_t condDepth = frame.condDepth;
+    llvm::ArrayRef<Token> line(begin, p);
+    /// 空指令
+    if (line.empty()) {
+        return;
+    }
+
+    const Token &directive = line[0];
+    llvm::SMLoc loc = llvm::SMLoc::getFromPointer(directive.ptr);
+    llvm::StringRef name = GetSpelling(directive);
+    line = line.drop_front();
+
+    if (name == "if" || name == "ifdef" || name == "ifndef") {
+        Conditional cond{hash.ptr, IsActive(), false, false, false};
+        if (cond.wasActive) {
+            if (name == "if") {
+                cond.active = EvalCondition(line, directive);
+            } else {
+                if (line.empty() || !IsIdentifierLike(line[0])) {
+                    diagEngine.Report(loc, diag::err_pp_macro_name);
+                }
+                bool defined = macros.count(GetSpelling(line[0]));
+                cond.active = name == "ifdef" ? defined : !defined;
+            }
+        }
+        cond.taken = cond.active;
+        conds.push_back(cond);
+        return;
+    }
+
+    if (name == "elif" || name == "else" || name == "endif") {
+        if (conds.size() <= condDepth) {
+            diagEngine.Report(loc, diag::err_pp_unmatched, name);
+        }
+        Conditional &cond = conds.back();
+        if (name == "endif") {
+            conds.pop_back();
+            return;
+        }
+        if (cond.sawElse) {
+            diagEngine.Report(loc, diag::err_pp_else_after_else, name);
+        }
+        if (name == "else") {
+            cond.active = cond.wasActive && !cond.taken;
+            cond.sawElse = true;
+        } else {
+            cond.active = cond.wasActive && !cond.taken && EvalCondition(line, directive);
+        }
+        cond.taken |= cond.active;
+        return;
+    }
+
+    /// 无效的区域中只需要跟踪条件指令的嵌套
+    if (!IsActive()) {
+        return;
+    }
+
+    if (name == "define") {
+        HandleDefine(line, directive);
+    } else if (name == "undef") {
+        if (line.empty() || !IsIdentifierLike(line[0])) {
+            diagEngine.Report(loc, diag::err_pp_macro_name);
+        }
+        macros.erase(GetSpelling(line[0]));
+    } else if (name == "include") {
+        HandleInclude(frameIdx, hash, line);
+    } else if (name == "error" || name == "warning") {
+        llvm::StringRef msg;
+        if (!line.empty()) {
+            msg = llvm::StringRef(GetStart(line.front()), GetEnd(line.back()) - GetStart(line.front()));
+        }
+        diagEngine.Report(loc, name == "error" ? diag::err_pp_error : diag::warn_pp_warning, msg);
+    } else if (name != "pragma" && name != "line") {
+        /// #pragma once 在缓存头文件时已经识别，其它 pragma 和 #line 忽略
+        diagEngine.Report(loc, diag::err_pp_invalid_directive, name);
+    }
+}
+
+void Preprocessor::HandleDefine(llvm::ArrayRef<Token> line, const Token &directive) {
+    if (line.empty() || !IsIdentifierLike(line[0]) || GetSpelling(line[0]) == "defined") {
+        diagEngine.Report(llvm::SMLoc::getFromPointer(directive.ptr), diag::err_pp_macro_name);
+    }
+    const Token &nameTok = line[0];
+    Macro macro;
+    size_t i = 1;
+    /// 名字后紧跟 '(' 才是函数宏
+    if (i < line.size() && line[i].tokenType == TokenType::l_parent && line[i].ptr == GetEnd(nameTok)) {
+        macro.isFunction = true;
+        ++i;
+        auto paramError = [&]() {
+            const Token &tok = i < line.size() ? line[i] : nameTok;
+            diagEngine.Report(llvm::SMLoc::getFromPointer(tok.ptr), diag::err_pp_param);
+        };
+        if (i < line.size() && line[i].tokenType == TokenType::r_parent) {
+            ++i;
+        } else {
+            for (;;) {
+                if (i < line.size() && line[i].tokenType == TokenType::ellipse) {
+                    macro.isVariadic = true;
+                    macro.params.push_back("__VA_ARGS__");
+                    if (++i >= line.size() || line[i].tokenType != TokenType::r_parent) {
+                        paramError();
+                    }
+                    ++i;
+                    break;
+                }
+                if (i >= line.size() || !IsIdentifierLike(line[i])) {
+                    paramError();
+                }
+                macro.params.push_back(GetSpelling(line[i++]));
+                if (i < line.size() && line[i].tokenType == TokenType::r_parent) {
+                    ++i;
+                    break;
+                }
+                if (i >= line.size() || line[i].tokenType != TokenType::comma) {
+                    paramError();
+                }
+                ++i;
+            }
+        }
+    }
+    macro.body.assign(line.begin() + i, line.end());
+    if (nameTok.tokenType != TokenType::identifier) {
+        keywordMacros = true;
+    }
+    macros[GetSpelling(nameTok)] = std::move(macro);
+}
+
+void Preprocessor::HandleInclude(size_t frameIdx, const Token &hash, llvm::ArrayRef<Token> line) {
+    llvm::SMLoc loc = llvm::SMLoc::getFromPointer(hash.ptr);
+    std::vector<Token> expanded;
+    if (!line.empty() && line[0].tokenType == TokenType::identifier) {
+        ExpandTokens(line, expanded);
+        line = expanded;
+    }
+
+    std::string name;
+    bool quoted = false;
+    if (!line.empty() && line[0].tokenType == TokenType::str) {
+        name = lexer.GetLiteral(line[0]).strVal;
+        quoted = true;
+    } else if (!line.empty() && line[0].tokenType == TokenType::less) {
+        /// <sys/types.h> 被扫描成多个 token，按原文拼回去
+        size_t i = 1;
+        for (; i < line.size() && line[i].tokenType != TokenType::greater; ++i) {
+            if (i > 1 && GetStart(line[i]) != GetEnd(line[i - 1])) {
+                name += ' ';
+            }
+            name += GetSpelling(line[i]);
+        }
+        if (i == line.size() || name.empty()) {
+            diagEngine.Report(loc, diag::err_pp_expected_filename);
+        }
+    } else {
+        diagEngine.Report(loc, diag::err_pp_expected_filename);
+    }
+
+    const CachedHeader *header = ResolveInclude(name, quoted, frames[frameIdx].dir);
+    if (!header) {
+        diagEngine.Report(llvm::SMLoc::getFromPointer(line[0].ptr), diag::err_pp_file_not_found, name);
+    }
+    /// 已经包含过的 #pragma once 文件，或者 include guard 已定义，不需要再次扫描整个文件
+    if (precompiled.count(header->path)) {
+        return;
+    }
+    if (header->pragmaOnce && !onceIncluded.insert(header->path).second) {
+        return;
+    }
+    if (!header->guard.empty() && macros.count(header->guard)) {
+        return;
+    }
+
+    size_t depth = 0;
+    for (const Frame &frame : frames) {
+        depth += frame.isFile;
+    }
+    if (depth > kMaxIncludeDepth) {
+        diagEngine.Report(loc, diag::err_pp_include_depth);
+    }
+
+    if (addedBuffers.insert(header->path).second) {
+        mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(header->buffer->getMemBufferRef(), false), loc);
+    }
+    const Token *begin = header->tokens.data();
+    PushFile(begin, begin + header->tokens.size(), nullptr, llvm::sys::path::parent_path(header->path));
+}
+
+const CachedHeader *Preprocessor::ResolveInclude(llvm::StringRef name, bool quoted, llvm::StringRef dir) {
+    std::string key = ((quoted ? dir : "") + "\n" + name).str();
+    auto it = resolved.find(key);
+    if (it != resolved.end()) {
+        return it->second;
+    }
+
+    auto lookup = [&](llvm::StringRef base) -> const CachedHeader * {
+        llvm::SmallString<256> path(base);
+        llvm::sys::path::append(path, name);
+        llvm::SmallString<256> realPath;
+        if (llvm::sys::fs::real_path(path, realPath) || llvm::sys::fs::is_directory(realPath)) {
+            return nullptr;
+        }
+        return cache.Get(realPath);
+    };
+
+    const CachedHeader *header = nullptr;
+    if (llvm::sys::path::is_absolute(name)) {
+        header = lookup("");
+    } else {
+        if (quoted) {
+            header = lookup(dir);
+        }
+        for (size_t i = 0; !header && i < includeDirs.size(); ++i) {
+            header = lookup(includeDirs[i]);
+        }
+    }
+    resolved[key] = header;
+    return header;
+}
+
+namespace {
+/// #if 表达式求值，操作数都按 int64_t 计算
+/// live 为 false 的子表达式 (短路、?: 未选中的分支) 中除以 0 不报错
+class ConditionEvaluator {
+private:
+    Lexer &lexer;
+    DiagEngine &diagEngine;
+    llvm::ArrayRef<Token> tokens;
+    const Token &directive;
+    size_t pos{0};
+public:
+    ConditionEvaluator(Lexer &lexer, llvm::ArrayRef<Token> tokens, const Token &directive)
+        : lexer(lexer), diagEngine(lexer.GetDiagEngine()), tokens(tokens), directive(directive) {}
+
+    int64_t Evaluate() {
+        int64_t v = ParseConditional(true);
+        if (pos != tokens.size()) {
+            Error(diag::err_pp_expr);
+        }
+        return v;
+    }
+private:
+    /// 表达式中的 token 可能来自宏展开或者 defined 的替换，统一报告在指令处
+    void Error(unsigned diagId) {
+        diagEngine.Report(llvm::SMLoc::getFromPointer(directive.ptr), diagId);
+    }
+
+    bool Consume(TokenType tokenType) {
+        if (pos < tokens.size() && tokens[pos].tokenType == tokenType) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    static int GetPrecedence(TokenType tokenType) {
+        switch (tokenType) {
+        case TokenType::star:
+        case TokenType::slash:
+        case TokenType::percent:
+            return 10;
+        case TokenType::plus:
+        case TokenType::minus:
+            return 9;
+        case TokenType::less_less:
+        case TokenType::greater_greater:
+            return 8;
+        case TokenType::less:
+        case TokenType::less_equal:
+        case TokenType::greater:
+        case TokenType::greater_equal:
+            return 7;
+        case TokenType::equal_equal:
+        case TokenType::not_equal:
+            return 6;
+        case TokenType::amp:
+            return 5;
+        case TokenType::caret:
+            return 4;
+        case TokenType::pipe:
+            return 3;
+        case TokenType::ampamp:
+            return 2;
+        case TokenType::pipepipe:
+            return 1;
+        default:
+            return 0;
+        }
+    }
+
+    int64_t ParseConditional(bool live) {
+        int64_t cond = ParseBinary(1, live);
+        if (!Consume(TokenType::question)) {
+            return cond;
+        }
+        int64_t lhs = ParseConditional(live && cond != 0);
+        if (!Consume(TokenType::colon)) {
+            Error(diag::err_pp_expr);
+        }
+        int64_t rhs = ParseConditional(live && cond == 0);
+        return cond ? lhs : rhs;
+    }
+
+    int64_t ParseBinary(int minPrec, bool live) {
+        int64_t lhs = ParseUnary(live);
+        while (pos < tokens.size()) {
+            TokenType op = tokens[pos].tokenType;
+            int prec = GetPrecedence(op);
+            if (prec == 0 || prec < minPrec) {
+                break;
+            }
+            ++pos;
+            bool rhsLive = live;
+            if (op == TokenType::ampamp) {
+                rhsLive = live && lhs != 0;
+            } else if (op == TokenType::pipepipe) {
+                rhsLive = live && lhs == 0;
+            }
+            int64_t rhs = ParseBinary(prec + 1, rhsLive);
+            lhs = Apply(op, lhs, rhs, live);
+        }
+        return lhs;
+    }
+
+    int64_t Apply(TokenType op, int64_t lhs, int64_t rhs, bool live) {
+        /// 用无符号数计算避免溢出的未定义行为
+        uint64_t l = lhs, r = rhs;
+        switch (op) {
+        case TokenType::star: return l * r;
+        case TokenType::plus: return l + r;
+        case TokenType::minus: return l - r;
+        case TokenType::slash:
+        case TokenType::percent:
+            if (rhs == 0) {
+                if (live) {
+                    Error(diag::err_pp_div_zero);
+                }
+                return 0;
+            }
+            if (rhs == -1) {
+                return op == TokenType::slash ? 0 - l : 0;
+            }
+            return op == TokenType::slash ? lhs / rhs : lhs % rhs;
+        case TokenType::less_less: return l << (r & 63);
+        case TokenType::greater_greater: return lhs >> (r & 63);
+        case TokenType::less: return lhs < rhs;
+        case TokenType::less_equal: return lhs <= rhs;
+        case TokenType::greater: return lhs > rhs;
+        case TokenType::greater_equal: return lhs >= rhs;
+        case TokenType::equal_equal: return lhs == rhs;
+        case TokenType::not_equal: return lhs != rhs;
+        case TokenType::amp: return l & r;
+        case TokenType::caret: return l ^ r;
+        case TokenType::pipe: return l | r;
+        case TokenType::ampamp: return lhs && rhs;
+        case TokenType::pipepipe: return lhs || rhs;
+        default: return 0;
+        }
+    }
+
+    int64_t ParseUnary(bool live) {
+        if (pos == tokens.size()) {
+            Error(diag::err_pp_expr);
+        }
+        const Token &tok = tokens[pos++];
+        switch (tok.tokenType) {
+        case TokenType::plus:
+            return ParseUnary(live);
+        case TokenType::minus:
+            return 0 - static_cast<uint64_t>(ParseUnary(live));
+        case TokenType::tilde:
+            return ~ParseUnary(live);
+        case TokenType::exclaim:
+            return !ParseUnary(live);
+        case TokenType::l_parent: {
+            int64_t v = ParseConditional(live);
+            if (!Consume(TokenType::r_parent)) {
+                Error(diag::err_pp_expr);
+            }
+            return v;
+        }
+        case TokenType::number: {
+            const Literal &literal = lexer.GetLiteral(tok);
+            if (literal.ty->IsFloatType()) {
+                Error(diag::err_pp_expr);
+            }
+            return literal.value.v;
+        }
+        default:
+            /// 展开之后剩下的标识符 (包括关键字) 都当作 0
+            if (!IsIdentifierLike(tok)) {
+                Error(diag::err_pp_expr);
+            }
+            return 0;
+        }
+    }
+};
+}
+
+bool Preprocessor::EvalCondition(llvm::ArrayRef<Token> line, const Token &directive) {
+    /// defined 要在宏展开之前替换，否则 defined(X) 中的 X 会被展开
+    std::vector<Token> replaced;
+    replaced.reserve(line.size());
+    for (size_t i = 0; i < line.size(); ++i) {
+        if (line[i].tokenType != TokenType::identifier || GetSpelling(line[i]) != "defined") {
+            replaced.push_back(line[i]);
+            continue;
+        }
+        size_t j = i + 1;
+        bool paren = j < line.size() && line[j].tokenType == TokenType::l_parent;
+        j += paren;
+        if (j >= line.size() || !IsIdentifierLike(line[j])) {
+            diagEngine.Report(llvm::SMLoc::getFromPointer(directive.ptr), diag::err_pp_macro_name);
+        }
+        bool defined = macros.count(GetSpelling(line[j]));
+        if (paren && (++j >= line.size() || line[j].tokenType != TokenType::r_parent)) {
+            diagEngine.Report(llvm::SMLoc::getFromPointer(directive.ptr), diag::err_pp_expr);
+        }
+        Token tok = line[i];
+        tok.tokenType = TokenType::number;
+        tok.ptr = defined ? kTrueText : kFalseText;
+        tok.len = 1;
+        replaced.push_back(tok);
+        i = j;
+    }
+
+    std::vector<Token> expanded;
+    ExpandTokens(replaced, expanded);
+    return ConditionEvaluator(lexer, expanded, directive).Evaluate() != 0;
+}
+
+Preprocessor::Macro *Preprocessor::FindMacro(const Token &tok) {
+    if (macros.empty()) {
+        return nullptr;
+    }
+    if (tok.tokenType != TokenType::identifier && !(keywordMacros && IsIdentifierLike(tok))) {
+        return nullptr;
+    }
+    auto it = macros.find(llvm::StringRef(tok.ptr, tok.len));
+    if (it == macros.end() || it->second.disabled) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+bool Preprocessor::ExpandMacro(Macro &macro, const Token &name) {
+    std::vector<std::vector<Token>> args;
+    if (macro.isFunction) {
+        const Token *next = PeekToken();
+        if (!next || next->tokenType != TokenType::l_parent) {
+            return false;
+        }
+        Token lparen;
+        NextToken(lparen);
+        CollectArgs(macro, name, args);
+    }
+
+    auto result = std::make_unique<std::vector<Token>>();
+    Substitute(macro, name, args, *result);
+    for (Token &tok : *result) {
+        tok.row = name.row;
+        tok.col = name.col;
+    }
+
+    Frame frame;
+    frame.cur = result->data();
+    frame.end = frame.cur + result->size();
+    frame.owned = std::move(result);
+    frame.macro = &macro;
+    macro.disabled = true;
+    frames.push_back(std::move(frame));
+    return true;
+}
+
+bool Preprocessor::CollectArgs(Macro &macro, const Token &name, std::vector<std::vector<Token>> &args) {
+    llvm::StringRef macroName(name.ptr, name.len);
+    /// 可变参数宏的最后一个参数吞掉剩下所有的逗号
+    size_t named = macro.params.size() - macro.isVariadic;
+    int depth = 0;
+    args.emplace_back();
+    for (;;) {
+        Token tok;
+        if (!NextToken(tok)) {
+            diagEngine.Report(llvm::SMLoc::getFromPointer(name.ptr), diag::err_pp_unterminated_call, macroName);
+        }
+        if (tok.tokenType == TokenType::l_parent) {
+            ++depth;
+        } else if (tok.tokenType == TokenType::r_parent) {
+            if (depth == 0) {
+                break;
+            }
+            --depth;
+        } else if (tok.tokenType == TokenType::comma && depth == 0 && !(macro.isVariadic && args.size() > named)) {
+            args.emplace_back();
+            continue;
+        }
+        args.back().push_back(tok);
+    }
+
+    /// f() 对于没有参数的宏是 0 个参数，f(a) 对于 f(x, ...) 省略了可变参数
+    if (macro.params.empty() && args.size() == 1 && args[0].empty()) {
+        args.clear();
+    }
+    if (macro.isVariadic && args.size() == named) {
+        args.emplace_back();
+    }
+    if (args.size() != macro.params.size()) {
+        diagEngine.Report(llvm::SMLoc::getFromPointer(name.ptr), diag::err_pp_macro_args, macroName,
+                          macro.params.size(), args.size());
+    }
+    return true;
+}
+
+void Preprocessor::Substitute(Macro &macro, const Token &name, std::vector<std::vector<Token>> &args,
+                              std::vector<Token> &out) {
+    auto paramIndex = [&](const Token &tok) -> int {
+        if (!macro.isFunction || !IsIdentifierLike(tok)) {
+            return -1;
+        }
+        llvm::StringRef spelling(tok.ptr, tok.len);
+        for (size_t i = 0; i < macro.params.size(); ++i) {
+            if (macro.params[i] == spelling) {
+                return i;
+            }
+        }
+        return -1;
+    };
+
+    /// 每个参数最多展开一次
+    std::vector<std::vector<Token>> expanded(args.size());
+    std::vector<bool> isExpanded(args.size());
+    /// ## 左边是一个空参数时 out 的长度，这时 ## 只是把右边接上去
+    size_t placemarker = SIZE_MAX;
+
+    const std::vector<Token> &body = macro.body;
+    for (size_t i = 0; i < body.size(); ++i) {
+        const Token &tok = body[i];
+        if (tok.tokenType == TokenType::hash && macro.isFunction && i + 1 < body.size()) {
+            int p = paramIndex(body[i + 1]);
+            if (p >= 0) {
+                out.push_back(Stringize(args[p], name));
+                ++i;
+                continue;
+            }
+        }
+
+        if (tok.tokenType == TokenType::hashhash && i + 1 < body.size()) {
+            const Token &rhsTok = body[++i];
+            int p = paramIndex(rhsTok);
+            llvm::ArrayRef<Token> rhs = p >= 0 ? llvm::ArrayRef<Token>(args[p]) : llvm::ArrayRef<Token>(rhsTok);
+            /// GNU 扩展: , ## __VA_ARGS__ 在可变参数为空时删掉逗号，不为空时不拼接
+            bool gnuComma = !out.empty() && out.back().tokenType == TokenType::comma && macro.isVariadic &&
+                            p == static_cast<int>(macro.params.size()) - 1;
+            if (rhs.empty()) {
+                if (gnuComma) {
+                    out.pop_back();
+                }
+                placemarker = out.size();
+                continue;
+            }
+            if (out.empty() || placemarker == out.size() || gnuComma) {
+                out.insert(out.end(), rhs.begin(), rhs.end());
+                continue;
+            }
+            Token lhs = out.back();
+            out.back() = Paste(lhs, rhs[0], name);
+            out.insert(out.end(), rhs.begin() + 1, rhs.end());
+            continue;
+        }
+
+        int p = paramIndex(tok);
+        if (p < 0) {
+            out.push_back(tok);
+            continue;
+        }
+        /// ## 的操作数不展开
+        if (i + 1 < body.size() && body[i + 1].tokenType == TokenType::hashhash) {
+            out.insert(out.end(), args[p].begin(), args[p].end());
+            if (args[p].empty()) {
+                placemarker = out.size();
+            }
+            continue;
+        }
+        if (!isExpanded[p]) {
+            ExpandTokens(args[p], expanded[p]);
+            isExpanded[p] = true;
+        }
+        out.insert(out.end(), expanded[p].begin(), expanded[p].end());
+    }
+}
+
+void Preprocessor::ExpandTokens(llvm::ArrayRef<Token> tokens, std::vector<Token> &out) {
+    if (tokens.empty()) {
+        return;
+    }
+    size_t savedBaseDepth = baseDepth;
+    baseDepth = frames.size();
+    Frame frame;
+    frame.cur = tokens.begin();
+    frame.end = tokens.end();
+    frames.push_back(std::move(frame));
+    Run(out);
+    baseDepth = savedBaseDepth;
+}
+
+Token Preprocessor::Paste(const Token &lhs, const Token &rhs, const Token &name) {
+    std::string text = (GetSpelling(lhs) + GetSpelling(rhs)).str();
+    std::vector<Token> tokens;
+    LexScratch(text, llvm::SMLoc::getFromPointer(name.ptr), tokens);
+    if (tokens.size() != 1) {
+        diagEngine.Report(llvm::SMLoc::getFromPointer(name.ptr), diag::err_pp_paste, text);
+    }
+    return tokens[0];
+}
+
+Token Preprocessor::Stringize(llvm::ArrayRef<Token> tokens, const Token &name) {
+    std::string text = "\"";
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if (i > 0 && GetStart(tokens[i]) != GetEnd(tokens[i - 1])) {
+            text += ' ';
+        }
+        llvm::StringRef spelling = GetSpelling(tokens[i]);
+        bool literal = tokens[i].tokenType == TokenType::str || spelling[0] == '\'';
+        for (char c : spelling) {
+            if (literal && (c == '"' || c == '\\')) {
+                text += '\\';
+            }
+            text += c;
+        }
+    }
+    text += '"';
+    std::vector<Token> result;
+    LexScratch(text, llvm::SMLoc::getFromPointer(name.ptr), result);
+    return result[0];
+}
+
+void Preprocessor::LexScratch(llvm::StringRef text, llvm::SMLoc loc, std::vector<Token> &out,
+                              llvm::StringRef bufferName) {
+    unsigned id = mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBufferCopy(text, bufferName), loc);
+    Lexer scratch(mgr, diagEngine, id);
+    scratch.Tokenize(out);
+    out.pop_back();
+}
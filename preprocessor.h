@@ -0,0 +1,147 @@
+#pragma once
+#include "lexer.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// 一个头文件扫描出来的 token 流 (宏展开和条件编译之前)，创建后只读
+struct CachedHeader {
+    std::string path;
+    std::unique_ptr<llvm::MemoryBuffer> buffer;
+    /// 不含 eof
+    std::vector<Token> tokens;
+    /// 整个文件被 #ifndef X / #define X ... #endif 包住时为 X，X 已定义时再次包含可以直接跳过
+    std::string guard;
+    bool pragmaOnce{false};
+};
+
+/// 进程内共享的头文件缓存，被很多编译单元包含的头文件只读取、扫描一次
+/// 由 Driver 持有，CompileFiles 的多个线程可以同时访问
+class HeaderCache {
+private:
+    std::mutex mutex;
+    llvm::StringMap<std::unique_ptr<CachedHeader>> headers;
+public:
+    /// path 必须是规范化之后的路径，文件不存在时返回 nullptr
+    const CachedHeader *Get(llvm::StringRef path);
+};
+
+/// token 流 -> 处理 #include/#define/#if 之后的 token 流
+/// 宏展开出来的 token 仍然指向宏定义处的源码 (GetLiteral 依赖这一点)，行列号改为展开处的行列号
+class Preprocessor {
+private:
+    struct Macro {
+        std::vector<Token> body;
+        std::vector<llvm::StringRef> params;
+        bool isFunction{false};
+        bool isVariadic{false};
+        /// 正在展开时不会再次展开自身
+        bool disabled{false};
+    };
+
+    /// #if 嵌套中的一层
+    struct Conditional {
+        const char *loc;
+        /// 外层是否有效
+        bool wasActive;
+        /// 当前分支是否有效
+        bool active;
+        /// 已经有一个分支有效过
+        bool taken;
+        bool sawElse;
+    };
+
+    /// token 的来源: 一个文件，或者一次宏展开/宏参数
+    struct Frame {
+        const Token *cur;
+        const Token *end;
+        std::unique_ptr<std::vector<Token>> owned;
+        Macro *macro{nullptr};
+        /// 文件才有: 所在目录，用于查找 "" 形式的头文件; 进入文件时 #if 的嵌套深度
+        bool isFile{false};
+        std::string dir;
+        size_t condDepth{0};
+    };
+
+    Lexer &lexer;
+    llvm::SourceMgr &mgr;
+    DiagEngine &diagEngine;
+    HeaderCache &cache;
+    std::vector<std::string> includeDirs;
+    /// -D 转换成的 #define 文本
+    std::string predefines;
+
+    llvm::StringMap<Macro> macros;
+    /// 有以关键字为名字的宏时，关键字 token 也需要查找宏
+    bool keywordMacros{false};
+    std::vector<Conditional> conds;
+    std::vector<Frame> frames;
+    /// 展开宏参数或 #if 表达式时不能越过的 frame 深度
+    size_t baseDepth{0};
+
+    /// "目录\n文件名" -> 头文件，同一个编译单元中重复的 #include 不再查找文件系统
+    llvm::StringMap<const CachedHeader *> resolved;
+    llvm::StringSet<> onceIncluded;
+    /// 已经包含在预编译头中的头文件，#include 时直接跳过
+    llvm::StringSet<> precompiled;
+    /// 已经加入 mgr 的头文件，诊断信息需要从 mgr 中找到 token 所在的 buffer
+    llvm::StringSet<> addedBuffers;
+public:
+    /// defines 中的每一项是 NAME 或 NAME=VALUE
+    Preprocessor(Lexer &lexer, HeaderCache &cache, llvm::ArrayRef<std::string> includeDirs = {},
+                 llvm::ArrayRef<std::string> defines = {});
+
+    /// 扫描 lexer 的 buffer 并预处理，追加到 tokens 中，最后一个是 eof
+    void Tokenize(std::vector<Token> &tokens);
+
+    /// 预编译头: 它的宏定义在 -D 之前生效，它包含过的头文件不再被 #include
+    void AddPrecompiled(llvm::StringRef macroDefinitions, llvm::ArrayRef<llvm::StringRef> includedFiles);
+    /// Tokenize 之后当前定义的所有宏，每行一个 #define
+    std::string GetMacroDefinitions() const;
+    /// Tokenize 过程中包含过的头文件 (规范化之后的路径)
+    std::vector<std::string> GetIncludedFiles() const;
+
+    /// 源码中没有 '#'，也没有 -D 或预编译头的宏 (hasPredefines) 时，Tokenize 只是普通的扫描，不会包含任何头文件
+    static bool IsPlainSource(llvm::StringRef source, bool hasPredefines) {
+        return !hasPredefines && !source.contains('#');
+    }
+    /// 同一行中不是空白的第一个 token
+    static bool IsLineStart(const Token &tok);
+    /// tok 和它前面的 prev 之间有没有 (未被续行符转义的) 换行
+    static bool IsNewLine(const Token &prev, const Token &tok);
+    /// tokens 是否整个被一个 #ifndef X / #endif 包住，是时返回 X
+    static llvm::StringRef DetectIncludeGuard(llvm::ArrayRef<Token> tokens);
+private:
+    void Run(std::vector<Token> &out);
+    void PushFile(const Token *begin, const Token *end, std::unique_ptr<std::vector<Token>> owned, llvm::StringRef dir);
+    void PopFrame();
+    bool NextToken(Token &tok);
+    const Token *PeekToken() const;
+    bool IsActive() const {
+        return conds.empty() || conds.back().active;
+    }
+
+    void HandleDirective(size_t frameIdx, const Token &hash);
+    void HandleInclude(size_t frameIdx, const Token &hash, llvm::ArrayRef<Token> line);
+    void HandleDefine(llvm::ArrayRef<Token> line, const Token &directive);
+    bool EvalCondition(llvm::ArrayRef<Token> line, const Token &directive);
+    const CachedHeader *ResolveInclude(llvm::StringRef name, bool quoted, llvm::StringRef dir);
+
+    Macro *FindMacro(const Token &tok);
+    /// 展开成功时把结果压入 frames; 函数宏后面没有 '(' 时返回 false
+    bool ExpandMacro(Macro &macro, const Token &name);
+    bool CollectArgs(Macro &macro, const Token &name, std::vector<std::vector<Token>> &args);
+    void Substitute(Macro &macro, const Token &name, std::vector<std::vector<Token>> &args, std::vector<Token> &out);
+    /// 单独展开一串 token (宏参数、#if 表达式)，不会读取它之后的 token
+    void ExpandTokens(llvm::ArrayRef<Token> tokens, std::vector<Token> &out);
+    Token Paste(const Token &lhs, const Token &rhs, const Token &name);
+    Token Stringize(llvm::ArrayRef<Token> tokens, const Token &name);
+    /// 把 text 放进一个新的 buffer 中扫描，结果不含 eof
+    void LexScratch(llvm::StringRef text, llvm::SMLoc loc, std::vector<Token> &out,
+                    llvm::StringRef bufferName = "<scratch space>");
+};
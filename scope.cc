@@ -16,14 +16,26 @@ std::shared_ptr<Symbol> Scope::FindObjSymbol(llvm::StringRef name) {
             return table[name];
         }
     }
-    return nullptr;
+    return FindExternalObjSymbol(name);
 }
 std::shared_ptr<Symbol> Scope::FindObjSymbolInCurEnv(llvm::StringRef name) {
     auto &table = envs.back()->objSymbolTable;
     if (table.count(name) > 0) {
         return table[name];
     }
-    return nullptr;
+    /// 预编译头中的符号属于全局作用域
+    return envs.size() == 1 ? FindExternalObjSymbol(name) : nullptr;
+}
+
+std::shared_ptr<Symbol> Scope::FindExternalObjSymbol(llvm::StringRef name) {
+    if (!external) {
+        return nullptr;
+    }
+    auto symbol = external->FindObjSymbol(name);
+    if (symbol) {
+        envs.front()->objSymbolTable.insert({name, symbol});
+    }
+    return symbol;
 }
 void Scope::AddObjSymbol(std::shared_ptr<CType> ty, llvm::StringRef name) {
     auto symbol = std::make_shared<Symbol>(SymbolKind::kobj, ty, name);
@@ -42,7 +54,7 @@ std::shared_ptr<Symbol> Scope::FindTagSymbol(llvm::StringRef name) {
             return table[name];
         }
     }
-    return nullptr;
+    return FindExternalTagSymbol(name);
 }
 
 std::shared_ptr<Symbol> Scope::FindTagSymbolInCurEnv(llvm::StringRef name) {
@@ -50,10 +62,47 @@ std::shared_ptr<Symbol> Scope::FindTagSymbolInCurEnv(llvm::StringRef name) {
     if (table.count(name) > 0) {
         return table[name];
     }
-    return nullptr;
+    return envs.size() == 1 ? FindExternalTagSymbol(name) : nullptr;
+}
+
+std::shared_ptr<Symbol> Scope::FindExternalTagSymbol(llvm::StringRef name) {
+    if (!external) {
+        return nullptr;
+    }
+    auto symbol = external->FindTagSymbol(name);
+    if (symbol) {
+        envs.front()->tagSymbolTable.insert({name, symbol});
+    }
+    return symbol;
 }
 
 void Scope::AddTagSymbol(std::shared_ptr<CType> ty, llvm::StringRef name) {
     auto symbol = std::make_shared<Symbol>(SymbolKind::ktag, ty, name);
     envs.back()->tagSymbolTable.insert({name, symbol});
-}
\ No newline at end of file
+}
+
+size_t Scope::GetNumSymbols() const {
+    size_t num = 0;
+    for (const auto &env : envs) {
+        num += env->objSymbolTable.size() + env->tagSymbolTable.size();
+    }
+    return num;
+}
+
+static size_t GetSymbolTableSize(const llvm::StringMap<std::shared_ptr<Symbol>> &table) {
+    /// 每个桶是一个指针加一个 hash 值
+    size_t size = table.getNumBuckets() * (sizeof(void *) + sizeof(unsigned));
+    for (const auto &entry : table) {
+        /// make_shared 把 Symbol 和引用计数分配在一起
+        size += sizeof(entry) + entry.getKeyLength() + 1 + sizeof(Symbol) + 2 * sizeof(long);
+    }
+    return size;
+}
+
+size_t Scope::GetMemorySize() const {
+    size_t size = envs.capacity() * sizeof(envs[0]);
+    for (const auto &env : envs) {
+        size += sizeof(Env) + GetSymbolTableSize(env->objSymbolTable) + GetSymbolTableSize(env->tagSymbolTable);
+    }
+    return size;
+}
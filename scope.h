@@ -18,6 +18,16 @@ public:
     Symbol(SymbolKind kind, std::shared_ptr<CType> ty, llvm::StringRef name):kind(kind), ty(ty), name(name) {}
     std::shared_ptr<CType> GetTy() {return ty;}
     SymbolKind GetKind() {return kind;}
+    llvm::StringRef GetName() {return name;}
+};
+
+/// 全局作用域之外的符号来源 (预编译头)
+/// 所有作用域中都找不到某个名字时才会查询，找到的符号由 Scope 加入全局作用域，之后不会再次查询
+class ExternalSymbolSource {
+public:
+    virtual ~ExternalSymbolSource() {}
+    virtual std::shared_ptr<Symbol> FindObjSymbol(llvm::StringRef name) = 0;
+    virtual std::shared_ptr<Symbol> FindTagSymbol(llvm::StringRef name) = 0;
 };
 
 
@@ -31,8 +41,16 @@ public:
 class Scope {
 private:
     std::vector<std::shared_ptr<Env>> envs;
+    ExternalSymbolSource *external{nullptr};
 public:
     Scope();
+    void SetExternalSource(ExternalSymbolSource *source) {
+        external = source;
+    }
+    /// 全局作用域，--emit-pch 从这里取出要序列化的符号
+    const Env &GetGlobalEnv() const {
+        return *envs.front();
+    }
     void EnterScope();
     void ExitScope();
     std::shared_ptr<Symbol> FindObjSymbol(llvm::StringRef name);
@@ -43,4 +61,11 @@ public:
     std::shared_ptr<Symbol> FindTagSymbol(llvm::StringRef name);
     std::shared_ptr<Symbol> FindTagSymbolInCurEnv(llvm::StringRef name);
     void AddTagSymbol(std::shared_ptr<CType> ty, llvm::StringRef name);
+
+    /// -fmem-report: 当前所有作用域中的符号个数，以及符号表(桶、entry、key、Symbol)占用的字节数
+    size_t GetNumSymbols() const;
+    size_t GetMemorySize() const;
+private:
+    std::shared_ptr<Symbol> FindExternalObjSymbol(llvm::StringRef name);
+    std::shared_ptr<Symbol> FindExternalTagSymbol(llvm::StringRef name);
 };
\ No newline at end of file
@@ -344,14 +344,14 @@ std::shared_ptr<AstNode> Sema::SemaNumberExprNode(Token tok,int val,std::shared_
     return expr;
 }
 
-std::shared_ptr<AstNode> Sema::SemaNumberExprNode(Token tok, std::shared_ptr<CType> ty) {
+std::shared_ptr<AstNode> Sema::SemaNumberExprNode(Token tok, const Literal &literal) {
     auto expr = std::make_shared<NumberExpr>();
     expr->tok = tok;
-    expr->ty = ty;
-    if (ty->IsIntegerType()) {
-        expr->value.v = tok.value.v;
+    expr->ty = literal.ty;
+    if (literal.ty->IsIntegerType()) {
+        expr->value.v = literal.value.v;
     }else {
-        expr->value.d = tok.value.d;
+        expr->value.d = literal.value.d;
     }
     return expr;  
 }
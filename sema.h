@@ -18,7 +18,7 @@ public:
     std::shared_ptr<AstNode> SemaVariableDeclNode(Token tok, std::shared_ptr<CType> ty, bool isGlobal);
     std::shared_ptr<AstNode> SemaVariableAccessNode(Token tok);
     std::shared_ptr<AstNode> SemaNumberExprNode(Token tok, int val, std::shared_ptr<CType> ty);
-    std::shared_ptr<AstNode> SemaNumberExprNode(Token tok, std::shared_ptr<CType> ty);
+    std::shared_ptr<AstNode> SemaNumberExprNode(Token tok, const Literal &literal);
     std::shared_ptr<AstNode> SemaStringExprNode(Token tok, std::string val, std::shared_ptr<CType> ty);
     std::shared_ptr<AstNode> SemaBinaryExprNode( std::shared_ptr<AstNode> left,std::shared_ptr<AstNode> right, BinaryOp op, Token tok);
 
@@ -51,6 +51,15 @@ public:
     void ExitScope();
     void SetMode(Mode mode);
     void UnSetMode();
+
+    const Scope &GetScope() const {
+        return scope;
+    }
+
+    /// --include-pch
+    void SetExternalSource(ExternalSymbolSource *source) {
+        scope.SetExternalSource(source);
+    }
 private:
     Scope scope;
     std::stack<Mode> modeStack;
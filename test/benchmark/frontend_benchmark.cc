@@ -0,0 +1,219 @@
+#include <benchmark/benchmark.h>
+#include "lexer.h"
+#include "parser.h"
+#include "sema.h"
+#include "codegen.h"
+#include "synthetic.h"
+
+/// 单独驱动 lexer/parser/sema/codegen 的微基准，用来验证某个热点路径上的优化
+/// ./frontend_benchmark --benchmark_filter=Lexer --benchmark_repetitions=5
+
+/// 只包含全局声明的程序，parser 几乎全部时间都在 ParseDeclStmt 中
+static std::string GenerateDecls(int count) {
+    std::string out;
+    llvm::raw_string_ostream os(out);
+    os << "struct point { int x; int y; };\n";
+    for (int i = 0; i < count; ++i) {
+        switch (i % 4) {
+        case 0: os << "int g" << i << " = " << i << ";\n"; break;
+        case 1: os << "int *p" << i << ", a" << i << "[8];\n"; break;
+        case 2: os << "struct point s" << i << " = {" << i << ", 2};\n"; break;
+        default: os << "int t" << i << "[4] = {1, 2, 3, " << i << "};\n"; break;
+        }
+    }
+    return out;
+}
+
+/// 类似头文件的内容: 大量函数原型，夹杂少量 typedef 和 struct
+static std::string GeneratePrototypes(int count) {
+    std::string out;
+    llvm::raw_string_ostream os(out);
+    os << "struct point { int x; int y; };\n";
+    for (int i = 0; i < count; ++i) {
+        switch (i % 4) {
+        case 0: os << "int f" << i << "(int a, int b);\n"; break;
+        case 1: os << "struct point *f" << i << "(struct point *p, int n, char *name);\n"; break;
+        case 2: os << "int f" << i << "(const char *fmt, ...);\n"; break;
+        default: os << "typedef int (*cb" << i << ")(int a, void *data);\n"; break;
+        }
+    }
+    return out;
+}
+
+static std::string GenerateFunctions(int count) {
+    SyntheticOptions opts;
+    opts.functions = count;
+    return GenerateSyntheticProgram(opts);
+}
+
+/// 每次迭代用新的 SourceMgr 和 Lexer 逐个 NextToken 扫描到 eof，统计 tokens/s 和吞吐
+static void LexAll(benchmark::State &state, const std::string &source) {
+    int64_t tokens = 0;
+    for (auto _ : state) {
+        llvm::SourceMgr mgr;
+        DiagEngine diagEngine(mgr);
+        mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(source, "bench", false), llvm::SMLoc());
+        Lexer lexer(mgr, diagEngine);
+        Token tok;
+        do {
+            lexer.NextToken(tok);
+            ++tokens;
+        } while (tok.tokenType != TokenType::eof);
+        benchmark::DoNotOptimize(tok);
+    }
+    state.counters["tokens/s"] = benchmark::Counter(tokens, benchmark::Counter::kIsRate);
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+
+/// 每次迭代都经过 ParseProgram 完整解析一遍，包含 lexer 和 sema 的开销，统计外部声明 decls/s
+static void ParseAll(benchmark::State &state, const std::string &source) {
+    int64_t decls = 0;
+    for (auto _ : state) {
+        llvm::SourceMgr mgr;
+        DiagEngine diagEngine(mgr);
+        mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(source, "bench", false), llvm::SMLoc());
+        Lexer lexer(mgr, diagEngine);
+        Sema sema(diagEngine);
+        Parser parser(lexer, sema);
+        auto program = parser.ParseProgram();
+        decls += program->externalDecls.size();
+        benchmark::DoNotOptimize(program);
+    }
+    state.counters["decls/s"] = benchmark::Counter(decls, benchmark::Counter::kIsRate);
+}
+
+static void BM_LexerNextToken(benchmark::State &state) {
+    std::string source = GenerateFunctions(state.range(0));
+    LexAll(state, source);
+}
+BENCHMARK(BM_LexerNextToken)->Arg(100)->Arg(1000)->Unit(benchmark::kMillisecond);
+
+/// 只有关键字和标识符，衡量关键字识别的开销
+static void BM_LexerKeywords(benchmark::State &state) {
+    static const char *words[] = {"int", "x", "unsigned", "count", "return", "while", "value_1", "struct",
+                                  "node", "register", "default", "typedef", "ptr", "sizeof", "char", "i"};
+    std::string source;
+    for (int i = 0; i < state.range(0); ++i) {
+        source += words[i % std::size(words)];
+        source += i % 8 == 7 ? '\n' : ' ';
+    }
+    LexAll(state, source);
+}
+BENCHMARK(BM_LexerKeywords)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+/// 注释和缩进很多的生成代码，衡量空白/注释跳过的开销
+static void BM_LexerComments(benchmark::State &state) {
+    std::string source;
+    for (int i = 0; i < state.range(0); ++i) {
+        source += "/*\n * generated state " + std::to_string(i) + ", see the transition table below for the\n"
+                  " * inputs accepted in this state and the actions taken on each of them.\n */\n"
+                  "                int s" + std::to_string(i) + " = " + std::to_string(i) + ";    // next state\n"
+                  "\n";
+    }
+    LexAll(state, source);
+}
+BENCHMARK(BM_LexerComments)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+/// 生成的查找表: 十进制、十六进制、八进制整数和浮点数常量
+static void BM_LexerNumbers(benchmark::State &state) {
+    std::string source;
+    llvm::raw_string_ostream os(source);
+    for (int i = 0; i < state.range(0); ++i) {
+        unsigned v = i * 2654435761u;
+        switch (i % 4) {
+        case 0: os << v; break;
+        case 1: os << llvm::format_hex(v, 10) << 'u'; break;
+        case 2: os << '0' << llvm::format("%o", v & 0xffff); break;
+        default: os << llvm::format("%.9g", v / 1024.0) << (i % 8 == 3 ? "f" : ""); break;
+        }
+        os << (i % 8 == 7 ? ",\n" : ", ");
+    }
+    LexAll(state, source);
+}
+BENCHMARK(BM_LexerNumbers)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+/// 十几 MB 的生成代码一次性扫描成 token 数组，参数是线程数
+static void BM_LexerTokenize(benchmark::State &state) {
+    static std::string source = GenerateFunctions(20000);
+    int64_t tokens = 0;
+    for (auto _ : state) {
+        llvm::SourceMgr mgr;
+        DiagEngine diagEngine(mgr);
+        mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(source, "bench", false), llvm::SMLoc());
+        Lexer lexer(mgr, diagEngine);
+        lexer.SetParallel(state.range(0));
+        std::vector<Token> vec;
+        lexer.Tokenize(vec);
+        tokens += vec.size();
+        benchmark::DoNotOptimize(vec.data());
+    }
+    state.counters["tokens/s"] = benchmark::Counter(tokens, benchmark::Counter::kIsRate);
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_LexerTokenize)->Arg(1)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/// 全局变量声明，经过 ParseProgram 驱动 ParseDeclStmt(isGlobal)
+static void BM_ParserDeclStmt(benchmark::State &state) {
+    std::string source = GenerateDecls(state.range(0));
+    ParseAll(state, source);
+}
+BENCHMARK(BM_ParserDeclStmt)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+/// 头文件中几乎全是函数原型，衡量外部声明的声明符解析
+static void BM_ParserPrototypes(benchmark::State &state) {
+    std::string source = GeneratePrototypes(state.range(0));
+    ParseAll(state, source);
+}
+BENCHMARK(BM_ParserPrototypes)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+/// 只计 sema 的时间: 标识符在循环外扫描一次，每次迭代用新的 Sema 声明全部全局变量，
+/// 再对相邻的两个变量做一次查找和加法的类型检查，衡量符号表的插入和查找
+static void BM_SemaVariableDecl(benchmark::State &state) {
+    std::string source;
+    for (int i = 0; i < state.range(0); ++i) {
+        source += "g" + std::to_string(i) + (i % 8 == 7 ? "\n" : " ");
+    }
+    llvm::SourceMgr mgr;
+    DiagEngine diagEngine(mgr);
+    mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(source, "bench", false), llvm::SMLoc());
+    Lexer lexer(mgr, diagEngine);
+    std::vector<Token> tokens;
+    lexer.Tokenize(tokens);
+    tokens.pop_back();
+
+    int64_t decls = 0;
+    for (auto _ : state) {
+        Sema sema(diagEngine);
+        for (const Token &tok : tokens) {
+            benchmark::DoNotOptimize(sema.SemaVariableDeclNode(tok, CType::IntType, true));
+        }
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            auto left = sema.SemaVariableAccessNode(tokens[i - 1]);
+            auto right = sema.SemaVariableAccessNode(tokens[i]);
+            benchmark::DoNotOptimize(sema.SemaBinaryExprNode(left, right, BinaryOp::add, tokens[i]));
+        }
+        decls += tokens.size();
+    }
+    state.counters["decls/s"] = benchmark::Counter(decls, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_SemaVariableDecl)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+/// 只计 codegen 的时间: ast 在循环外生成一次，每次迭代都是一个新的 module
+static void BM_CodeGenFuncDecl(benchmark::State &state) {
+    std::string source = GenerateFunctions(state.range(0));
+    llvm::SourceMgr mgr;
+    DiagEngine diagEngine(mgr);
+    mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(source, "bench", false), llvm::SMLoc());
+    Lexer lexer(mgr, diagEngine);
+    Sema sema(diagEngine);
+    Parser parser(lexer, sema);
+    auto program = parser.ParseProgram();
+
+    int64_t instructions = CodeGen(program).GetModule()->getInstructionCount();
+    for (auto _ : state) {
+        CodeGen codegen(program);
+        benchmark::DoNotOptimize(codegen.GetModule());
+    }
+    state.counters["instrs/s"] = benchmark::Counter(instructions * state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CodeGenFuncDecl)->Arg(100)->Arg(1000)->Unit(benchmark::kMillisecond);
@@ -1149,6 +1149,34 @@ TEST(CodeGenTest, c1) {
     ASSERT_EQ(res, true);
 }
 
+/// 外部声明只解析一次: 全局函数指针、返回函数指针的函数、在定义之前声明的函数
+TEST(CodeGenTest, external_decl_func_ptr) {
+    bool res = TestProgramUseJit(R"(
+        typedef int (*func_t)(int a, int b);
+        int add(int a, int b) { return a + b; }
+        int sub(int a, int b);
+        int (*gp)(int x, int y);
+        int (*gp2)(int x, int y);
+        int x = 2;
+        int g = 3, h[2] = {4, 5};
+        int (*pick(int which))(int a, int b) {
+            if (which) return add;
+            return sub;
+        }
+        int sub(int a, int b) { return a - b; }
+        int main (void)
+        {
+            func_t fp = add;
+            int (*lp)(int a, int b) = sub;
+            int a = 1;
+            gp = sub;
+            gp2 = add;
+            return fp(1, 2) + gp(5, 3) + h[g - 2] + pick(1)(2, 3) + pick(0)(9, 4) + gp2(x, a) + lp(a, a);
+        }
+    )",23);
+    ASSERT_EQ(res, true);
+}
+
 TEST(CodeGenTest, cast_1) {
     bool res = TestProgramUseJit(R"(
         int printf(const char *fmg, ...);
@@ -1213,4 +1241,49 @@ TEST(CodeGenTest, typedef_point) {
         }
     )");
     ASSERT_EQ(res, true);
-}
\ No newline at end of file
+}
+
+TEST(CodeGenTest, target_attrs) {
+    llvm::SourceMgr mgr;
+    DiagEngine diagEngine(mgr);
+    mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer("int f(); int main(){return f();}", "stdin"), llvm::SMLoc());
+
+    Lexer lex(mgr, diagEngine);
+    Sema sema(diagEngine);
+    Parser parser(lex, sema);
+
+    auto program = parser.ParseProgram();
+    CodeGen codegen(program, nullptr, {"x86-64-v3", "+avx2,-bmi"});
+    auto &module = codegen.GetModule();
+    llvm::Function *mainFn = module->getFunction("main");
+    ASSERT_NE(mainFn, nullptr);
+    EXPECT_EQ(mainFn->getFnAttribute("target-cpu").getValueAsString(), "x86-64-v3");
+    EXPECT_EQ(mainFn->getFnAttribute("target-features").getValueAsString(), "+avx2,-bmi");
+    /// 只有函数定义才设置
+    EXPECT_FALSE(module->getFunction("f")->hasFnAttribute("target-cpu"));
+}
+
+TEST(CodeGenTest, debug_info) {
+    llvm::SourceMgr mgr;
+    DiagEngine diagEngine(mgr);
+    mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer("int main(){\n  int a = 3;\n  return a;\n}", "stdin"), llvm::SMLoc());
+
+    Lexer lex(mgr, diagEngine);
+    Sema sema(diagEngine);
+    Parser parser(lex, sema);
+
+    auto program = parser.ParseProgram();
+    CodeGenOptions options;
+    options.debugInfo = true;
+    CodeGen codegen(program, nullptr, options);
+    auto &module = codegen.GetModule();
+    EXPECT_FALSE(llvm::verifyModule(*module));
+
+    llvm::Function *mainFn = module->getFunction("main");
+    ASSERT_NE(mainFn->getSubprogram(), nullptr);
+    EXPECT_EQ(mainFn->getSubprogram()->getLine(), 1u);
+    /// return 语句的位置
+    auto *ret = mainFn->back().getTerminator();
+    ASSERT_TRUE(ret->getDebugLoc());
+    EXPECT_EQ(ret->getDebugLoc().getLine(), 3u);
+}
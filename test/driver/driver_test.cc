@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include "driver.h"
+#include "linker.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+
+/// 把 content 写到一个临时文件中，返回路径
+static std::string WriteTempFile(llvm::StringRef content, llvm::StringRef suffix) {
+    llvm::SmallString<128> path;
+    EXPECT_FALSE(llvm::sys::fs::createTemporaryFile("driver_test", suffix, path));
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec);
+    os << content;
+    return std::string(path);
+}
+
+/// 两个编译单元都有字符串常量和同名的 static 函数，拆分成多个分区生成目标文件后仍然可以链接到一起
+TEST(DriverTest, codegen_partitions_link) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    std::vector<std::string> inputs = {
+        WriteTempFile("static int helper(int x) { return x + 1; }\n"
+                      "char *name_a() { return \"a\"; }\n"
+                      "int fa() { char *s = name_a(); return helper(1) + s[0]; }\n", "c"),
+        WriteTempFile("static int helper(int x) { return x + 2; }\n"
+                      "char *name_b() { return \"b\"; }\n"
+                      "int fa();\n"
+                      "int main() { char *s = name_b(); return fa() + helper(0) + s[0] - 190; }\n", "c"),
+    };
+    std::vector<std::string> objects = {inputs[0] + ".o", inputs[1] + ".o"};
+
+    CompileOptions opts;
+    opts.fileType = llvm::CodeGenFileType::ObjectFile;
+    opts.codegenPartitions = 2;
+    Driver driver(opts);
+    ASSERT_TRUE(driver.InitTarget());
+    ASSERT_TRUE(driver.CompileFiles(inputs, objects, 1));
+
+    std::string exe = inputs[1] + ".out";
+    ASSERT_TRUE(LinkExecutable(driver.GetTriple(), objects, exe));
+    /// (1 + 1 + 'a') + (0 + 2) + 'b' - 190
+    EXPECT_EQ(llvm::sys::ExecuteAndWait(exe, {exe}), 9);
+
+    for (const auto &file : inputs) {
+        llvm::sys::fs::remove(file);
+    }
+    for (const auto &file : objects) {
+        llvm::sys::fs::remove(file);
+    }
+    llvm::sys::fs::remove(exe);
+}
@@ -165,4 +165,130 @@ TEST(LexerTest, expr_01) {
         expectedVec.push_back(Token{TokenType::semi, 2, 6});
         return expectedVec;
     });
-}
\ No newline at end of file
+}
+
+TEST(LexerTest, keyword_all) {
+    bool res = TestLexerWithContent(
+        "char case long auto void union while short float const signed sizeof struct static switch return\n"
+        "double extern inline default typedef volatile unsigned register do", []()->std::vector<Token> {
+        std::vector<Token> expectedVec;
+        expectedVec.push_back(Token{TokenType::kw_char, 1, 1});
+        expectedVec.push_back(Token{TokenType::kw_case, 1, 6});
+        expectedVec.push_back(Token{TokenType::kw_long, 1, 11});
+        expectedVec.push_back(Token{TokenType::kw_auto, 1, 16});
+        expectedVec.push_back(Token{TokenType::kw_void, 1, 21});
+        expectedVec.push_back(Token{TokenType::kw_union, 1, 26});
+        expectedVec.push_back(Token{TokenType::kw_while, 1, 32});
+        expectedVec.push_back(Token{TokenType::kw_short, 1, 38});
+        expectedVec.push_back(Token{TokenType::kw_float, 1, 44});
+        expectedVec.push_back(Token{TokenType::kw_const, 1, 50});
+        expectedVec.push_back(Token{TokenType::kw_signed, 1, 56});
+        expectedVec.push_back(Token{TokenType::kw_sizeof, 1, 63});
+        expectedVec.push_back(Token{TokenType::kw_struct, 1, 70});
+        expectedVec.push_back(Token{TokenType::kw_static, 1, 77});
+        expectedVec.push_back(Token{TokenType::kw_switch, 1, 84});
+        expectedVec.push_back(Token{TokenType::kw_return, 1, 91});
+        expectedVec.push_back(Token{TokenType::kw_double, 2, 1});
+        expectedVec.push_back(Token{TokenType::kw_extern, 2, 8});
+        expectedVec.push_back(Token{TokenType::kw_inline, 2, 15});
+        expectedVec.push_back(Token{TokenType::kw_default, 2, 22});
+        expectedVec.push_back(Token{TokenType::kw_typedef, 2, 30});
+        expectedVec.push_back(Token{TokenType::kw_volatile, 2, 38});
+        expectedVec.push_back(Token{TokenType::kw_unsigned, 2, 47});
+        expectedVec.push_back(Token{TokenType::kw_register, 2, 56});
+        expectedVec.push_back(Token{TokenType::kw_do, 2, 65});
+        return expectedVec;
+    });
+    ASSERT_EQ(res, true);
+}
+
+TEST(LexerTest, keyword_prefix) {
+    bool res = TestLexerWithContent("iff in chars cas sizeofx Int siz_eof", []()->std::vector<Token> {
+        std::vector<Token> expectedVec;
+        expectedVec.push_back(Token{TokenType::identifier, 1, 1});
+        expectedVec.push_back(Token{TokenType::identifier, 1, 5});
+        expectedVec.push_back(Token{TokenType::identifier, 1, 8});
+        expectedVec.push_back(Token{TokenType::identifier, 1, 14});
+        expectedVec.push_back(Token{TokenType::identifier, 1, 18});
+        expectedVec.push_back(Token{TokenType::identifier, 1, 26});
+        expectedVec.push_back(Token{TokenType::identifier, 1, 30});
+        return expectedVec;
+    });
+    ASSERT_EQ(res, true);
+}
+
+TEST(LexerTest, comment) {
+    bool res = TestLexerWithContent("a /* x\n y */b // c\n                                          d\n"
+                                    "/* a long comment spanning more than one simd block ** / *\n\n */ e/**/f",
+                                    []()->std::vector<Token> {
+        std::vector<Token> expectedVec;
+        expectedVec.push_back(Token{TokenType::identifier, 1, 1});
+        expectedVec.push_back(Token{TokenType::identifier, 2, 6});
+        expectedVec.push_back(Token{TokenType::identifier, 3, 43});
+        expectedVec.push_back(Token{TokenType::identifier, 6, 5});
+        expectedVec.push_back(Token{TokenType::identifier, 6, 10});
+        return expectedVec;
+    });
+    ASSERT_EQ(res, true);
+}
+
+TEST(LexerTest, tokenize) {
+    llvm::StringRef content = "int a = 0x1f + 'b';\nchar *s = \"x\\n\"; double d = 1.5;";
+    llvm::SourceMgr mgr;
+    DiagEngine diagEngine(mgr);
+    mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(content, "stdin"), llvm::SMLoc());
+    Lexer lexer(mgr, diagEngine);
+    std::vector<Token> tokens;
+    lexer.Tokenize(tokens);
+
+    ASSERT_EQ(tokens.size(), 19);
+    EXPECT_EQ(tokens.back().tokenType, TokenType::eof);
+    EXPECT_EQ(tokens[9].row, 2);
+    EXPECT_EQ(tokens[9].col, 7);
+
+    /// 整个文件扫描完之后再取字面量的值，需要从源码文本重新计算
+    EXPECT_EQ(lexer.GetLiteral(tokens[3]).value.v, 31);
+    EXPECT_EQ(lexer.GetLiteral(tokens[5]).value.v, 'b');
+    EXPECT_EQ(lexer.GetLiteral(tokens[11]).strVal, "x\n");
+    EXPECT_EQ(lexer.GetLiteral(tokens[16]).value.d, 1.5);
+}
+
+/// 切分点落在块注释、多行字符串中间，以及有多余空行时，并行扫描的结果都要与串行扫描相同
+TEST(LexerTest, tokenize_parallel) {
+    std::string content;
+    for (int i = 0; i < 200; ++i) {
+        content += "int v" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+        if (i % 7 == 0) {
+            content += "/*\nint x = 1;\n\"\n*/\n";
+        }
+        if (i % 11 == 0) {
+            content += "char *s = \"a\nint y;\n\";\n\n\n";
+        }
+        if (i % 13 == 0) {
+            content += "// \" not a string\nx /* y */ 'c'\n";
+        }
+    }
+
+    auto tokenize = [&](unsigned threads, std::vector<Token> &tokens) {
+        llvm::SourceMgr mgr;
+        DiagEngine diagEngine(mgr);
+        mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(content, "stdin"), llvm::SMLoc());
+        Lexer lexer(mgr, diagEngine);
+        lexer.SetParallel(threads, 32);
+        lexer.Tokenize(tokens);
+    };
+    std::vector<Token> expected;
+    tokenize(1, expected);
+    for (unsigned threads : {2, 3, 8, 64}) {
+        std::vector<Token> tokens;
+        tokenize(threads, tokens);
+        ASSERT_EQ(tokens.size(), expected.size());
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            EXPECT_EQ(tokens[i].tokenType, expected[i].tokenType);
+            EXPECT_EQ(tokens[i].row, expected[i].row);
+            EXPECT_EQ(tokens[i].col, expected[i].col);
+            EXPECT_EQ(tokens[i].ptr - content.data(), expected[i].ptr - content.data());
+            EXPECT_EQ(tokens[i].len, expected[i].len);
+        }
+    }
+}
@@ -0,0 +1,226 @@
+#include <gtest/gtest.h>
+#include "pch.h"
+#include "parser.h"
+#include "preprocessor.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+static const char *kHeader =
+    "#define SQ(x) ((x) * (x))\n"
+    "#define LOG(fmt, ...) printf(fmt, __VA_ARGS__)\n"
+    "struct node { int val; struct node *next; };\n"
+    "typedef struct node Node;\n"
+    "typedef struct { char c; double d; } Pair;\n"
+    "union num { int i; double d; };\n"
+    "typedef int Arr[4];\n"
+    "int printf(const char *fmt, ...);\n"
+    "Node *push(Node *head, int val);\n";
+
+/// 把 content 写到一个临时文件中，返回规范化之后的路径
+static std::string WriteTempFile(llvm::StringRef content, llvm::StringRef suffix) {
+    llvm::SmallString<128> path, realPath;
+    EXPECT_FALSE(llvm::sys::fs::createTemporaryFile("pch_test", suffix, path));
+    {
+        std::error_code ec;
+        llvm::raw_fd_ostream os(path, ec);
+        os << content;
+    }
+    EXPECT_FALSE(llvm::sys::fs::real_path(path, realPath));
+    return std::string(realPath);
+}
+
+/// 预处理并解析 content, 把全局作用域写成预编译头，返回文件路径
+/// headerPath 是记录为已包含的头文件，为空时把 content 写到一个临时文件中
+static std::string EmitPCH(llvm::StringRef content, std::string headerPath = "",
+                           llvm::ArrayRef<std::string> options = {}) {
+    if (headerPath.empty()) {
+        headerPath = WriteTempFile(content, "h");
+    }
+    llvm::SourceMgr mgr;
+    DiagEngine diagEngine(mgr);
+    mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(content, "header.h"), llvm::SMLoc());
+    Lexer lexer(mgr, diagEngine);
+    Sema sema(diagEngine);
+    HeaderCache cache;
+    Preprocessor preprocessor(lexer, cache);
+    std::vector<Token> tokens;
+    preprocessor.Tokenize(tokens);
+    Parser parser(lexer, sema, std::move(tokens));
+    parser.ParseProgram();
+
+    llvm::SmallString<128> path;
+    EXPECT_FALSE(llvm::sys::fs::createTemporaryFile("pch_test", "pch", path));
+    EXPECT_TRUE(PCHWriter().Write(sema.GetScope(), preprocessor.GetMacroDefinitions(), {headerPath}, options, path));
+    return std::string(path);
+}
+
+TEST(PCHTest, lazy_lookup) {
+    std::string headerPath = WriteTempFile(kHeader, "h");
+    auto file = PCHFile::Open(EmitPCH(kHeader, headerPath));
+    ASSERT_TRUE(file);
+    EXPECT_EQ(file->header->numObjSymbols, 5u);
+    /// 匿名 struct 只能通过 Pair 找到
+    EXPECT_EQ(file->header->numTagSymbols, 2u);
+    ASSERT_EQ(file->includedFiles.size(), 1u);
+    EXPECT_EQ(file->includedFiles[0], headerPath);
+
+    PCHReader reader(*file);
+    Scope scope;
+    scope.SetExternalSource(&reader);
+    EXPECT_EQ(reader.GetNumLoadedTypes(), 0u);
+
+    auto printfSym = scope.FindObjSymbol("printf");
+    ASSERT_TRUE(printfSym);
+    EXPECT_EQ(printfSym->GetKind(), SymbolKind::kobj);
+    auto *funcTy = llvm::dyn_cast<CFuncType>(printfSym->GetTy().get());
+    ASSERT_TRUE(funcTy);
+    EXPECT_TRUE(funcTy->IsVarArg());
+    EXPECT_EQ(funcTy->GetName(), "printf");
+    ASSERT_EQ(funcTy->GetParams().size(), 1u);
+    EXPECT_EQ(funcTy->GetParams()[0].name, "fmt");
+    EXPECT_EQ(funcTy->GetRetType(), CType::IntType);
+    /// 只反序列化了 printf 用到的类型: 函数、int、char、char *
+    EXPECT_EQ(reader.GetNumLoadedTypes(), 4u);
+
+    /// 找到之后加入全局作用域，不会再次查询
+    EXPECT_EQ(scope.FindObjSymbol("printf"), printfSym);
+    EXPECT_FALSE(scope.FindObjSymbol("missing"));
+    EXPECT_FALSE(scope.FindTagSymbol("Node"));
+}
+
+TEST(PCHTest, types) {
+    auto file = PCHFile::Open(EmitPCH(kHeader));
+    ASSERT_TRUE(file);
+    PCHReader reader(*file);
+    Scope scope;
+    scope.SetExternalSource(&reader);
+
+    auto nodeSym = scope.FindTagSymbol("node");
+    ASSERT_TRUE(nodeSym);
+    auto *recordTy = llvm::dyn_cast<CRecordType>(nodeSym->GetTy().get());
+    ASSERT_TRUE(recordTy);
+    EXPECT_EQ(recordTy->GetSize(), 16);
+    ASSERT_EQ(recordTy->GetMembers().size(), 2u);
+    EXPECT_EQ(recordTy->GetMembers()[1].name, "next");
+    EXPECT_EQ(recordTy->GetMembers()[1].offset, 8);
+    /// 自引用的指针指向同一个类型对象
+    auto *nextTy = llvm::dyn_cast<CPointType>(recordTy->GetMembers()[1].ty.get());
+    ASSERT_TRUE(nextTy);
+    EXPECT_EQ(nextTy->GetBaseType().get(), recordTy);
+
+    auto typedefSym = scope.FindObjSymbol("Node");
+    ASSERT_TRUE(typedefSym);
+    EXPECT_EQ(typedefSym->GetKind(), SymbolKind::ktypedef);
+    EXPECT_EQ(typedefSym->GetTy().get(), recordTy);
+
+    auto pairSym = scope.FindObjSymbol("Pair");
+    ASSERT_TRUE(pairSym);
+    auto *pairTy = llvm::dyn_cast<CRecordType>(pairSym->GetTy().get());
+    ASSERT_TRUE(pairTy);
+    EXPECT_TRUE(CType::IsAnonyRecordName(pairTy->GetName()));
+    EXPECT_EQ(pairTy->GetSize(), 16);
+
+    auto numSym = scope.FindTagSymbol("num");
+    ASSERT_TRUE(numSym);
+    EXPECT_EQ(numSym->GetTy()->GetSize(), 8);
+
+    auto arrSym = scope.FindObjSymbol("Arr");
+    ASSERT_TRUE(arrSym);
+    auto *arrTy = llvm::dyn_cast<CArrayType>(arrSym->GetTy().get());
+    ASSERT_TRUE(arrTy);
+    EXPECT_EQ(arrTy->GetElementCount(), 4);
+    EXPECT_EQ(arrTy->GetElementType(), CType::IntType);
+}
+
+TEST(PCHTest, parse_with_pch) {
+    /// 头文件在预编译头中，源文件中的 #include 会被跳过
+    std::string realPath = WriteTempFile("#error should not be included\n", "h");
+    auto file = PCHFile::Open(EmitPCH(kHeader, realPath));
+    ASSERT_TRUE(file);
+
+    std::string source = "#include \"" + realPath + "\"\n" +
+                         "int main() { Node n; n.val = SQ(3); Node *p = push(&n, 1); LOG(\"%d\", p->val); return 0; }";
+    llvm::SourceMgr mgr;
+    DiagEngine diagEngine(mgr);
+    mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(source, "main.c"), llvm::SMLoc());
+    Lexer lexer(mgr, diagEngine);
+    PCHReader reader(*file);
+    Sema sema(diagEngine);
+    sema.SetExternalSource(&reader);
+    HeaderCache cache;
+    Preprocessor preprocessor(lexer, cache);
+    preprocessor.AddPrecompiled(file->macros, file->includedFiles);
+    std::vector<Token> tokens;
+    preprocessor.Tokenize(tokens);
+    Parser parser(lexer, sema, std::move(tokens));
+    auto program = parser.ParseProgram();
+    ASSERT_EQ(program->externalDecls.size(), 1u);
+    /// 没有用到的 Pair/num/Arr 不会被反序列化
+    EXPECT_FALSE(sema.GetScope().GetGlobalEnv().objSymbolTable.count("Pair"));
+    EXPECT_TRUE(sema.GetScope().GetGlobalEnv().objSymbolTable.count("push"));
+}
+
+TEST(PCHTest, macro_definitions) {
+    llvm::SourceMgr mgr;
+    DiagEngine diagEngine(mgr);
+    mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer("#define CAT(a, b) a##b\n#define V(...) f(__VA_ARGS__)\n"
+                                                            "#define EMPTY\n#define N -1\n",
+                                                            "header.h"),
+                           llvm::SMLoc());
+    Lexer lexer(mgr, diagEngine);
+    HeaderCache cache;
+    Preprocessor preprocessor(lexer, cache);
+    std::vector<Token> tokens;
+    preprocessor.Tokenize(tokens);
+    std::string text = preprocessor.GetMacroDefinitions();
+    EXPECT_NE(text.find("#define CAT(a, b) a##b\n"), std::string::npos);
+    EXPECT_NE(text.find("#define V(...) f(__VA_ARGS__)\n"), std::string::npos);
+    EXPECT_NE(text.find("#define EMPTY\n"), std::string::npos);
+    EXPECT_NE(text.find("#define N -1\n"), std::string::npos);
+}
+
+TEST(PCHTest, stale) {
+    std::string headerPath = WriteTempFile(kHeader, "h");
+    std::string pchPath = EmitPCH(kHeader, headerPath, {"-DN=1", "-I/usr/include"});
+    EXPECT_TRUE(PCHFile::Open(pchPath, {"-DN=1", "-I/usr/include"}));
+
+    /// -D/-I 与生成时不同
+    EXPECT_FALSE(PCHFile::Open(pchPath));
+    EXPECT_FALSE(PCHFile::Open(pchPath, {"-DN=2", "-I/usr/include"}));
+
+    /// 头文件被修改
+    {
+        std::error_code ec;
+        llvm::raw_fd_ostream os(headerPath, ec, llvm::sys::fs::OF_Append);
+        os << "int added;\n";
+    }
+    EXPECT_FALSE(PCHFile::Open(pchPath, {"-DN=1", "-I/usr/include"}));
+
+    /// 头文件被删除
+    llvm::sys::fs::remove(headerPath);
+    EXPECT_FALSE(PCHFile::Open(pchPath, {"-DN=1", "-I/usr/include"}));
+}
+
+TEST(PCHTest, invalid_file) {
+    llvm::SmallString<128> path;
+    ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("pch_test", "pch", path));
+    {
+        std::error_code ec;
+        llvm::raw_fd_ostream os(path, ec);
+        os << "int main() { return 0; }";
+    }
+    EXPECT_FALSE(PCHFile::Open(path));
+
+    /// 截断的文件
+    std::string valid = EmitPCH(kHeader);
+    auto buf = llvm::MemoryBuffer::getFile(valid);
+    ASSERT_TRUE(buf);
+    {
+        std::error_code ec;
+        llvm::raw_fd_ostream os(path, ec);
+        os << (*buf)->getBuffer().drop_back(4);
+    }
+    EXPECT_FALSE(PCHFile::Open(path));
+    EXPECT_FALSE(PCHFile::Open("/nonexistent/file.pch"));
+}
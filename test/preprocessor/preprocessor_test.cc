@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include "preprocessor.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+/// 预处理之后的 token 按空格拼接，不含 eof
+static std::string Preprocess(llvm::StringRef content, HeaderCache &cache, llvm::StringRef fileName = "stdin",
+                              llvm::ArrayRef<std::string> includeDirs = {}, llvm::ArrayRef<std::string> defines = {}) {
+    llvm::SourceMgr mgr;
+    DiagEngine diagEngine(mgr);
+    mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(content, fileName), llvm::SMLoc());
+    Lexer lexer(mgr, diagEngine);
+    Preprocessor preprocessor(lexer, cache, includeDirs, defines);
+    std::vector<Token> tokens;
+    preprocessor.Tokenize(tokens);
+    EXPECT_EQ(tokens.back().tokenType, TokenType::eof);
+
+    std::string s;
+    for (size_t i = 0; i + 1 < tokens.size(); ++i) {
+        const Token &tok = tokens[i];
+        if (i > 0) {
+            s += ' ';
+        }
+        if (tok.tokenType == TokenType::str) {
+            s += llvm::StringRef(tok.ptr - 1, tok.len + 1);
+        } else {
+            s += llvm::StringRef(tok.ptr, tok.len);
+        }
+    }
+    return s;
+}
+
+static std::string Preprocess(llvm::StringRef content) {
+    HeaderCache cache;
+    return Preprocess(content, cache);
+}
+
+/// 在临时目录中写一个文件，返回路径
+static std::string WriteFile(llvm::StringRef dir, llvm::StringRef name, llvm::StringRef content) {
+    llvm::SmallString<128> path(dir);
+    llvm::sys::path::append(path, name);
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec);
+    EXPECT_FALSE(ec);
+    os << content;
+    return std::string(path);
+}
+
+TEST(PreprocessorTest, object_macro) {
+    EXPECT_EQ(Preprocess("#define N 10\nint a[N];\n#undef N\nint N;"), "int a [ 10 ] ; int N ;");
+    EXPECT_EQ(Preprocess("#define A B\n#define B A\nint A;"), "int A ;");
+    EXPECT_EQ(Preprocess("#define EMPTY\nint EMPTY x;"), "int x ;");
+}
+
+TEST(PreprocessorTest, function_macro) {
+    EXPECT_EQ(Preprocess("#define SQ(x) ((x) * (x))\nint a = SQ(1 + 2);"), "int a = ( ( 1 + 2 ) * ( 1 + 2 ) ) ;");
+    /// 名字和 '(' 之间有空格的是对象宏
+    EXPECT_EQ(Preprocess("#define F (x)\nint a = F(1);"), "int a = ( x ) ( 1 ) ;");
+    EXPECT_EQ(Preprocess("#define F(x) x + 1\nint F; int a = F(F(2));"), "int F ; int a = 2 + 1 + 1 ;");
+    EXPECT_EQ(Preprocess("#define MAX(a, b) ((a) > (b) ? (a) : (b))\nint m = MAX(f(1, 2), 3);"),
+              "int m = ( ( f ( 1 , 2 ) ) > ( 3 ) ? ( f ( 1 , 2 ) ) : ( 3 ) ) ;");
+    EXPECT_EQ(Preprocess("#define ADD(a, \\\n            b) a + b\nint s = ADD(1,\n 2);"), "int s = 1 + 2 ;");
+}
+
+TEST(PreprocessorTest, stringize_and_paste) {
+    EXPECT_EQ(Preprocess("#define STR(x) #x\nchar *s = STR(a  \"b\"+c);"), "char * s = \"a \\\"b\\\"+c\" ;");
+    EXPECT_EQ(Preprocess("#define CAT(a, b) a ## b\nint CAT(x, 1) = CAT(1, 2);"), "int x1 = 12 ;");
+    EXPECT_EQ(Preprocess("#define CAT(a, b) a ## b\nint CAT(, y);"), "int y ;");
+    EXPECT_EQ(Preprocess("#define LOG(fmt, ...) printf(fmt, ## __VA_ARGS__)\nLOG(\"a\"); LOG(\"%d\", 1, 2);"),
+              "printf ( \"a\" ) ; printf ( \"%d\" , 1 , 2 ) ;");
+    EXPECT_EQ(Preprocess("#define V(...) f(__VA_ARGS__)\nV(1, (2, 3));"), "f ( 1 , ( 2 , 3 ) ) ;");
+}
+
+TEST(PreprocessorTest, conditional) {
+    EXPECT_EQ(Preprocess("#if 0\nint a;\n#elif 2 > 1\nint b;\n#else\nint c;\n#endif"), "int b ;");
+    EXPECT_EQ(Preprocess("#define X\n#ifdef X\nint a;\n#endif\n#ifndef X\nint b;\n#endif"), "int a ;");
+    EXPECT_EQ(Preprocess("#if defined(X) || defined Y\nint a;\n#else\nint b;\n#endif"), "int b ;");
+    /// 无效区域中嵌套的 #if 只跟踪深度，不求值
+    EXPECT_EQ(Preprocess("#if 0\n#if 1 / 0\nint a;\n#else\nint b;\n#endif\n#endif\nint c;"), "int c ;");
+    /// 短路和 ?: 未选中的分支中除以 0 不报错
+    EXPECT_EQ(Preprocess("#if (1 || 1 / 0) && (0 ? 1 / 0 : 1)\nint a;\n#endif"), "int a ;");
+    EXPECT_EQ(Preprocess("#define N 4\n#if N * 2 == 8 && (-1 >> 1) == -1 && 'a' == 97 && UNDEFINED == 0\nint a;\n#endif"),
+              "int a ;");
+}
+
+TEST(PreprocessorTest, predefines) {
+    HeaderCache cache;
+    EXPECT_EQ(Preprocess("#ifdef DEBUG\nint d = DEBUG;\n#endif\nint n = SIZE;", cache, "stdin", {},
+                         {"DEBUG", "SIZE=16"}),
+              "int d = 1 ; int n = 16 ;");
+}
+
+TEST(PreprocessorTest, line_start) {
+    /// 只有行首的 '#' 才是指令，宏展开出来的 token 使用展开处的行列号
+    llvm::StringRef content = "  #define N 1\nint a = N;";
+    llvm::SourceMgr mgr;
+    DiagEngine diagEngine(mgr);
+    mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(content, "stdin"), llvm::SMLoc());
+    Lexer lexer(mgr, diagEngine);
+    HeaderCache cache;
+    Preprocessor preprocessor(lexer, cache);
+    std::vector<Token> tokens;
+    preprocessor.Tokenize(tokens);
+
+    ASSERT_EQ(tokens.size(), 6);
+    EXPECT_EQ(tokens[3].row, 2);
+    EXPECT_EQ(tokens[3].col, 9);
+    EXPECT_EQ(lexer.GetLiteral(tokens[3]).value.v, 1);
+}
+
+TEST(PreprocessorTest, include_guard) {
+    auto guard = [](llvm::StringRef content) {
+        llvm::SourceMgr mgr;
+        DiagEngine diagEngine(mgr);
+        mgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBuffer(content, "stdin"), llvm::SMLoc());
+        Lexer lexer(mgr, diagEngine);
+        std::vector<Token> tokens;
+        lexer.Tokenize(tokens);
+        tokens.pop_back();
+        return Preprocessor::DetectIncludeGuard(tokens).str();
+    };
+    EXPECT_EQ(guard("// a.h\n#ifndef A_H\n#define A_H\n#if X\nint a;\n#endif\n#endif\n"), "A_H");
+    EXPECT_EQ(guard("#ifndef A_H\n#define A_H\n#endif\nint b;"), "");
+    EXPECT_EQ(guard("#ifndef A_H\n#define A_H\n#else\nint b;\n#endif"), "");
+    EXPECT_EQ(guard("int b;\n#ifndef A_H\n#endif"), "");
+}
+
+TEST(PreprocessorTest, include) {
+    llvm::SmallString<128> dir;
+    ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("subc-pp", dir));
+    llvm::SmallString<128> sysDir(dir);
+    llvm::sys::path::append(sysDir, "sys");
+    ASSERT_FALSE(llvm::sys::fs::create_directory(sysDir));
+
+    WriteFile(dir, "a.h", "#ifndef A_H\n#define A_H\nint a;\n#endif\n");
+    WriteFile(dir, "b.h", "#pragma once\nint b;\n#include \"a.h\"\n");
+    WriteFile(sysDir, "c.h", "int c;\n");
+    std::string main = WriteFile(dir, "main.c", "");
+
+    HeaderCache cache;
+    std::vector<std::string> includeDirs{std::string(sysDir)};
+    llvm::StringRef content = "#include \"a.h\"\n#include \"b.h\"\n#include \"b.h\"\n#include <c.h>\n#include <c.h>\nint m;";
+    EXPECT_EQ(Preprocess(content, cache, main, includeDirs), "int a ; int b ; int c ; int c ; int m ;");
+
+    /// 第二个编译单元直接使用缓存中的 token，不会重新读取文件
+    llvm::SmallString<128> header(dir);
+    llvm::sys::path::append(header, "a.h");
+    llvm::SmallString<128> realPath;
+    ASSERT_FALSE(llvm::sys::fs::real_path(header, realPath));
+    const CachedHeader *cached = cache.Get(realPath);
+    ASSERT_NE(cached, nullptr);
+    EXPECT_EQ(cached->guard, "A_H");
+    EXPECT_EQ(cached->tokens.size(), 11);
+    WriteFile(dir, "a.h", "int changed;\n");
+    EXPECT_EQ(Preprocess("#include \"a.h\"\n#include \"a.h\"", cache, main), "int a ;");
+    EXPECT_EQ(cache.Get(realPath), cached);
+
+    EXPECT_TRUE(cache.Get(std::string(dir) + "/missing.h") == nullptr);
+    llvm::sys::fs::remove_directories(dir);
+}
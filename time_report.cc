@@ -0,0 +1,54 @@
+#include "time_report.h"
+#include <algorithm>
+#include <vector>
+
+TimeReport::TimeReport(llvm::StringRef fileName)
+    : group("subc", ("subc compile-time report: " + fileName.str())),
+      lexTimer("lex", "Preprocessor::Tokenize", group),
+      parseTimer("parse", "Parser + Sema", group),
+      codegenTimer("codegen", "CodeGen visitors", group),
+      verifyTimer("verify", "  verifyModule (per function)", group),
+      optTimer("opt", "IR optimization pipeline", group),
+      backendTimer("backend", "Backend (isel, regalloc, emission)", group) {}
+
+void TimeReport::RecordFunction(llvm::StringRef name, FuncPhase phase, const llvm::TimeRecord &start) {
+    llvm::TimeRecord elapsed = llvm::TimeRecord::getCurrentTime(false);
+    elapsed -= start;
+    funcTimes[phase][name] += elapsed;
+}
+
+void TimeReport::Clear() {
+    group.clear();
+    for (auto &times : funcTimes) {
+        times.clear();
+    }
+}
+
+void TimeReport::Print(llvm::raw_ostream &os, unsigned topN) {
+    /// 打印后清空，避免 TimerGroup 析构时再打印一次
+    group.print(os, true);
+
+    const char *phaseNames[] = {"parse", "codegen"};
+    for (int phase = kParse; phase <= kCodeGen; ++phase) {
+        auto &times = funcTimes[phase];
+        if (times.empty()) {
+            continue;
+        }
+        std::vector<llvm::StringMapEntry<llvm::TimeRecord> *> entries;
+        for (auto &entry : times) {
+            entries.push_back(&entry);
+        }
+        unsigned n = std::min<unsigned>(topN, entries.size());
+        std::partial_sort(entries.begin(), entries.begin() + n, entries.end(), [](auto *a, auto *b) {
+            return a->getValue().getWallTime() > b->getValue().getWallTime();
+        });
+
+        llvm::StringMap<llvm::TimeRecord> top;
+        for (unsigned i = 0; i < n; ++i) {
+            top[entries[i]->getKey()] = entries[i]->getValue();
+        }
+        std::string desc = "top " + std::to_string(n) + " functions by " + phaseNames[phase] + " time";
+        llvm::TimerGroup topGroup(std::string("subc-") + phaseNames[phase], desc, top);
+        topGroup.print(os, true);
+    }
+}
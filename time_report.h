@@ -0,0 +1,35 @@
+#pragma once
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+
+/// -ftime-report: 一个编译单元中各个阶段的耗时
+/// Timer 每次 start/stop 都要调用 getrusage(约 1us)，所以只包在粒度较粗的阶段外面；
+/// 单个函数的耗时用 TimeRecord 累加，打印时只输出 top N
+class TimeReport {
+public:
+    enum FuncPhase {
+        kParse,
+        kCodeGen
+    };
+private:
+    llvm::TimerGroup group;
+    llvm::StringMap<llvm::TimeRecord> funcTimes[2];
+public:
+    llvm::Timer lexTimer;
+    llvm::Timer parseTimer;
+    llvm::Timer codegenTimer;
+    llvm::Timer verifyTimer;
+    llvm::Timer optTimer;
+    llvm::Timer backendTimer;
+
+    TimeReport(llvm::StringRef fileName);
+
+    /// 累加 [start, now) 这段时间到函数 name 上
+    void RecordFunction(llvm::StringRef name, FuncPhase phase, const llvm::TimeRecord &start);
+
+    void Print(llvm::raw_ostream &os, unsigned topN);
+    /// 只读取 Timer 而不打印报告时调用，避免 TimerGroup 析构时打印
+    void Clear();
+};
@@ -1,4 +1,5 @@
 #include "type.h"
+#include <atomic>
 
 std::shared_ptr<CType> CType::VoidType = std::make_shared<CPrimaryType>(Kind::TY_Void, 0, 0, true);
 std::shared_ptr<CType> CType::CharType = std::make_shared<CPrimaryType>(Kind::TY_Char, 1, 1, true);
@@ -36,7 +37,8 @@ bool CType::IsArithType() {
 }
 
 llvm::StringRef CType::GenAnonyRecordName(TagKind tagKind) {
-    static long long idx = 0;
+    /// 多个文件会在不同线程中并发编译
+    static std::atomic<long long> idx{0};
     std::string name;
     if (tagKind == TagKind::kStruct) {
         name = "__1anony_struct_" + std::to_string(idx++) + "_";
@@ -49,6 +51,10 @@ llvm::StringRef CType::GenAnonyRecordName(TagKind tagKind) {
     return llvm::StringRef(buf, name.size());
 }
 
+bool CType::IsAnonyRecordName(llvm::StringRef name) {
+    return name.take_front(9) == "__1anony_";
+}
+
 /// 地址对齐算法
 /// 找到大于等于x，且按照align(必须是2的倍数)对其的最小地址
 /// (0, 1) => 0
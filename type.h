@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <memory>
 #include "llvm/IR/Type.h"
 
@@ -51,7 +52,16 @@ protected:
     int align;      /// 对齐数
     bool sign{true}; ///默认是有符号
 public:
-    CType(Kind kind, int size, int align, bool sign = true):kind(kind), size(size), align(align), sign(sign) {}
+    CType(Kind kind, int size, int align, bool sign = true):kind(kind), size(size), align(align), sign(sign) {
+        if (uint64_t *counts = AllocCounts()) {
+            ++counts[kind];
+        }
+    }
+    /// -fmem-report: 当前线程把各类类型的个数累加到这个数组 (由 MemReport 设置)，为空时不计数
+    static uint64_t *&AllocCounts() {
+        static thread_local uint64_t *counts = nullptr;
+        return counts;
+    }
     virtual ~CType() {}
     Kind GetKind() const {return kind;}
     int GetSize() const {
@@ -83,6 +93,8 @@ public:
     static std::shared_ptr<CType> LDoubleType;
 
     static llvm::StringRef GenAnonyRecordName(TagKind tagKind);
+    /// 是否是 GenAnonyRecordName 生成的名字
+    static bool IsAnonyRecordName(llvm::StringRef name);
 };
 
 class CPrimaryType : public CType {